@@ -0,0 +1,170 @@
+#!/usr/bin/env python3
+"""Compile a public suffix list into a C++ source holding the PSL trie.
+
+The generated file defines ``Url::PSL::builtin_table`` as constant data, laid
+out exactly like the trie ``PSL::compile`` (src/psl.cpp) builds at runtime:
+nodes in breadth-first order, the children of a node contiguous and sorted
+bytewise by their lowercased label.
+
+usage: compile_psl.py <public_suffix_list.dat> <output.cpp>
+"""
+from __future__ import annotations
+
+import re
+import sys
+from pathlib import Path
+
+NO_RULE = 0xFF
+MAX_CHILDREN = 0xFFFF
+MAX_LABEL = 0xFF
+ASCII_LOWER = bytes.maketrans(b"ABCDEFGHIJKLMNOPQRSTUVWXYZ", b"abcdefghijklmnopqrstuvwxyz")
+RULE = re.compile(rb"[^ \t\n\v\f\r]*")
+ICANN, PRIVATE = 1, 2
+
+
+def ace(label: bytes) -> bytes:
+    """Punycode a lowercased non-ASCII label as PSL::add does, or return it as-is."""
+    if label.isascii():
+        return label
+    try:
+        encoded = b"xn--" + label.decode("utf-8").encode("punycode")
+    except UnicodeError:
+        return label
+    return encoded if len(encoded) <= MAX_LABEL else label
+
+
+class Builder:
+    def __init__(self):
+        # each node is [children: dict[label, index], icann level, private level]
+        self.tree = [[{}, NO_RULE, NO_RULE]]
+        self.rules = 0
+
+    def add(self, rule: bytes, level_adjust: int, trim: int, section: int):
+        host = rule[trim:]
+        length = host.count(b".") + 1 + level_adjust
+        if length < 0 or length >= NO_RULE:
+            raise ValueError(f"Rule has too many segments: {rule!r}")
+
+        node = 0
+        for label in reversed(host.split(b".")):
+            label = ace(label.translate(ASCII_LOWER))
+            children = self.tree[node][0]
+            if label not in children:
+                children[label] = len(self.tree)
+                self.tree.append([{}, NO_RULE, NO_RULE])
+            node = children[label]
+
+        slot = 2 if section == PRIVATE else 1
+        if self.tree[node][slot] == NO_RULE:
+            self.rules += 1
+        self.tree[node][slot] = length
+
+    def read(self, stream):
+        section = ICANN
+        for line in stream:
+            # Section markers are comments, so look for them before trimming
+            if line.startswith(b"//"):
+                if b"===BEGIN PRIVATE DOMAINS===" in line:
+                    section = PRIVATE
+                elif b"===END PRIVATE DOMAINS===" in line:
+                    section = ICANN
+                continue
+            # Only take up to the first whitespace
+            line = RULE.match(line).group(0)
+            if not line:
+                continue
+            if line.startswith(b"*"):
+                if len(line) <= 2 or line[1:2] != b".":
+                    raise ValueError("Wildcard rule must be of form *.<host>")
+                self.add(line, 1, 2, section)
+            elif line.startswith(b"!"):
+                if len(line) <= 1:
+                    raise ValueError("Exception rule has no hostname.")
+                self.add(line, -1, 1, section)
+            else:
+                self.add(line, 0, 0, section)
+
+    def compile(self):
+        """Return (nodes, labels) with nodes as
+        (label, children, child_count, label_length, icann_level, private_level)."""
+        nodes = [[0, 0, 0, 0, NO_RULE, NO_RULE]]
+        labels = bytearray()
+        order = [0]
+        index = 0
+        while index < len(order):
+            children = self.tree[order[index]][0]
+            if len(children) > MAX_CHILDREN:
+                raise ValueError("Too many rules below a single label.")
+            nodes[index][1] = len(nodes)
+            nodes[index][2] = len(children)
+            for label in sorted(children):
+                if len(label) > MAX_LABEL:
+                    raise ValueError(f"Label too long: {label!r}")
+                child = children[label]
+                nodes.append([len(labels), 0, 0, len(label), *self.tree[child][1:]])
+                labels += label
+                order.append(child)
+            index += 1
+        return nodes, bytes(labels)
+
+
+def char_literal(byte: int) -> str:
+    char = chr(byte)
+    if char.isascii() and (char.isalnum() or char == "-"):
+        return f"'{char}'"
+    return f"'\\x{byte:02x}'"
+
+
+def render(source: str, nodes, labels: bytes, rules: int) -> str:
+    out = [
+        f"// Generated by cmake/compile_psl.py from {source}. Do not edit.",
+        '#include "psl.h"',
+        "",
+        "namespace Url",
+        "{",
+        "    namespace",
+        "    {",
+        "        constexpr PSL::Node nodes[] = {",
+    ]
+    out += [f"            {{{', '.join(map(str, node))}}}," for node in nodes]
+    out += ["        };", "", "        constexpr char labels[] = {"]
+    for start in range(0, len(labels), 16):
+        chunk = labels[start:start + 16]
+        out.append("            " + ", ".join(char_literal(b) for b in chunk) + ",")
+    out += [
+        "        };",
+        "    }",
+        "",
+        "    const PSL::Table PSL::builtin_table = {",
+        f"        nodes, {len(nodes)}, labels, {len(labels)}, {rules}",
+        "    };",
+        "}",
+        "",
+    ]
+    return "\n".join(out)
+
+
+def main(argv):
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 2
+    source, output = Path(argv[1]), Path(argv[2])
+    builder = Builder()
+    with source.open("rb") as stream:
+        builder.read(stream)
+    if builder.rules == 0:
+        # An empty list, as a failed download leaves, would build a library that
+        # finds no suffixes at all
+        sys.stderr.write(f"compile_psl.py: no rules in {source}\n")
+        return 1
+    nodes, labels = builder.compile()
+    output.parent.mkdir(parents=True, exist_ok=True)
+    text = render(source.name, nodes, labels, builder.rules)
+    # Leave the file untouched when nothing changed to avoid needless rebuilds
+    if not output.exists() or output.read_text() != text:
+        output.write_text(text)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -37,9 +37,16 @@
 #ifndef TLD_URLPARSER_H
 #define TLD_URLPARSER_H
 
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
 #include <iostream>
 #include <memory>
+#include <memory_resource>
+#include <optional>
+#include <stdexcept>
 #include <string>
+#include <string_view>
 #include <vector>
 
 #ifndef PUBLIC_SUFFIX_LIST_DAT
@@ -56,6 +63,317 @@ constexpr bool DEFAULT_IGNORE_WWW = false;
 using QueryParams = std::vector<std::string>;
 
 class Host;
+class Url;
+class ParamFilter;
+
+/**
+ * @brief Why a URL or hostname could not be parsed.
+ */
+enum class ErrorCode {
+    Ok = 0,
+    /// The URL is longer than 4 GiB.
+    UrlTooLong,
+    /// The port is not a decimal number.
+    PortNotANumber,
+    /// The port is negative or above 65535.
+    PortOutOfRange,
+    /// The public suffix of the hostname has an empty label, as in "a..ck".
+    EmptyLabel
+};
+
+/**
+ * @brief A description of an ErrorCode, for messages.
+ */
+const char* errorMessage(ErrorCode code) noexcept;
+
+/**
+ * @brief The normalizations Url::canonicalize() applies, combined with |.
+ */
+namespace Canonical {
+enum Option : unsigned {
+    /// Drop empty query and params pieces.
+    Strip = 1 << 0,
+    /// Sort the query and params pieces.
+    SortQuery = 1 << 1,
+    /// Drop the fragment.
+    Defrag = 1 << 2,
+    /// Drop the userinfo.
+    Deuserinfo = 1 << 3,
+    /// Resolve "." and ".." path segments and drop empty ones.
+    Abspath = 1 << 4,
+    /// Escape what must be escaped and unescape what need not be.
+    Escape = 1 << 5,
+    /// Like Escape, but keep reserved characters escaped.
+    StrictEscape = 1 << 6,
+    /// Drop the port when it is the default for the scheme.
+    RemoveDefaultPort = 1 << 7,
+    /// Sort the query and params pieces by name only, keeping the order of
+    /// pieces with the same name; implies SortQuery.
+    SortByName = 1 << 8,
+    /// Keep one piece of each name when sorting, the first with SortByName;
+    /// implies SortQuery.
+    UniqueNames = 1 << 9,
+    /// Every option from Strip through RemoveDefaultPort except StrictEscape:
+    /// what makes two URLs equivalent.
+    Equivalence = Strip | SortQuery | Defrag | Deuserinfo | Abspath | Escape |
+                  RemoveDefaultPort
+};
+}  // namespace Canonical
+
+/**
+ * @brief Either a parsed value or the reason it could not be parsed.
+ *
+ * Returned by the non-throwing parse functions, so that malformed input costs
+ * no exception.
+ *
+ * Example Usage:
+ * @code
+ *   auto url = TLD::Url::parse("https://example.com:99999/");
+ *   if (!url)
+ *       std::cerr << TLD::errorMessage(url.error()) << std::endl;
+ * @endcode
+ */
+template <typename T, typename E = ErrorCode>
+class Result {
+   public:
+    Result(T value) : value_(std::move(value)), error_() {}
+    Result(E error) : error_(error) {}
+
+    /**
+     * @brief Whether there is a value.
+     */
+    bool ok() const noexcept { return value_.has_value(); }
+    explicit operator bool() const noexcept { return ok(); }
+
+    /**
+     * @brief The error, which is E() when there is a value.
+     */
+    E error() const noexcept { return error_; }
+
+    /**
+     * @brief The value.
+     * @throws std::invalid_argument If there is none.
+     */
+    T& value() & {
+        check();
+        return *value_;
+    }
+    const T& value() const& {
+        check();
+        return *value_;
+    }
+    T&& value() && {
+        check();
+        return std::move(*value_);
+    }
+
+    /**
+     * @brief The value, or `fallback` if there is none.
+     */
+    T valueOr(T fallback) const& { return ok() ? *value_ : std::move(fallback); }
+
+    /// Unchecked access to the value.
+    T& operator*() noexcept { return *value_; }
+    const T& operator*() const noexcept { return *value_; }
+    T* operator->() noexcept { return &*value_; }
+    const T* operator->() const noexcept { return &*value_; }
+
+   private:
+    void check() const {
+        if (!ok())
+            throw std::invalid_argument(errorMessage(error_));
+    }
+
+    std::optional<T> value_;
+    E error_;
+};
+
+/**
+ * @brief Parser settings together with the Public Suffix List they apply.
+ *
+ * Every Context owns its own PSL and options, so several suffix policies (for
+ * example an ICANN-only list and one with custom internal suffixes) can be used
+ * in one process. A Context is loaded independently of all others, and Url and
+ * Host objects built from it query its PSL directly.
+ *
+ * A Context must outlive the Url and Host objects built from it.
+ *
+ * Example Usage:
+ * @code
+ *   TLD::Context internal(true);
+ *   internal.loadPslFromString("com\ncorp.example.com\n");
+ *   TLD::Url url = internal.makeUrl("https://www.wiki.corp.example.com/");
+ *   std::cout << url.domain() << std::endl;  // "wiki"
+ * @endcode
+ */
+class Context {
+   public:
+    /**
+     * @brief The Context used by Url and Host when none is given.
+     * @return The process-wide Context, which the static Host::loadPsl* functions
+     * load into.
+     */
+    static Context& global() noexcept;
+
+   public:
+    /**
+     * @brief Construct a Context using the Public Suffix List built into the library.
+     * @param ignore_www Whether Url and Host built from this Context ignore the
+     * "www" subdomain.
+     */
+    explicit Context(const bool ignore_www = DEFAULT_IGNORE_WWW);
+    ~Context();
+
+    Context(const Context&) = delete;
+    Context& operator=(const Context&) = delete;
+
+    /**
+     * @brief Load the Public Suffix List of this Context from a file.
+     * @param filepath Path to the PSL file.
+     * @throws std::invalid_argument If the file cannot be opened or parsed.
+     */
+    void loadPslFromPath(const std::string& filepath);
+
+    /**
+     * @brief Load the Public Suffix List of this Context from a string.
+     * @param filestr The PSL content as a string.
+     * @throws std::invalid_argument If the content cannot be parsed.
+     */
+    void loadPslFromString(const std::string& filestr);
+
+    /**
+     * @brief Map a binary PSL snapshot and use it as the list of this Context.
+     * @param filepath Path to a snapshot written by Url::PSL::saveBinary.
+     * @throws std::invalid_argument If the file cannot be mapped.
+     */
+    void loadPslFromBinary(const std::string& filepath);
+
+    /**
+     * @brief Check if the Public Suffix List (PSL) of this Context is loaded.
+     * @return true if the PSL is loaded, false otherwise.
+     */
+    bool isPslLoaded() const noexcept;
+
+    /**
+     * @brief Whether Url and Host built from this Context ignore "www".
+     */
+    bool ignoreWWW() const noexcept;
+
+    /**
+     * @brief Parse a URL with the PSL and options of this Context.
+     * @param url The URL string to parse.
+     * @return The parsed Url.
+     */
+    Url makeUrl(const std::string& url) const;
+
+    /**
+     * @brief Parse a hostname with the PSL and options of this Context.
+     * @param host The hostname to parse.
+     * @return The parsed Host.
+     */
+    Host makeHost(const std::string& host) const;
+
+    /**
+     * @brief Counters of the host cache of a Context.
+     */
+    struct CacheStats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t size;
+        size_t capacity;
+    };
+
+    /**
+     * @brief Remember how the most used hosts decompose, so that parsing them
+     * again skips the PSL lookup.
+     *
+     * The cache is shared by every Url and Host built from this Context, from any
+     * thread. It holds about `capacity` hosts, split over a few shards, and each
+     * shard evicts approximately least recently used hosts first (CLOCK, which
+     * spares a host that was hit since the last sweep). Loading a new PSL empties
+     * it.
+     * @param capacity Number of hosts to keep; 0, the default, disables the cache.
+     */
+    void setHostCacheCapacity(size_t capacity);
+
+    /**
+     * @brief Hits, misses, size and capacity of the host cache.
+     */
+    CacheStats hostCacheStats() const;
+
+   private:
+    friend class Host;
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
+
+/**
+ * @brief Which query parameters Url::deparam() removes.
+ *
+ * Names match in any case. Build a filter once, as for tracking parameters,
+ * and apply it to any number of URLs:
+ * @code
+ *   const TLD::ParamFilter tracking{"utm_*", "fbclid", "gclid"};
+ *   TLD::Url clean = url.deparam(tracking);
+ * @endcode
+ * A filter is not changed by use, so threads may share it. A filter that was
+ * moved from removes nothing, and may be built up again with add().
+ */
+class ParamFilter {
+   public:
+    /**
+     * @brief A test of a parameter by its name and value, which is empty when
+     * the parameter has no '='.
+     */
+    using Predicate =
+        std::function<bool(std::string_view name, std::string_view value)>;
+
+    /**
+     * @brief Construct a filter that removes nothing.
+     */
+    ParamFilter();
+
+    /**
+     * @brief Construct a filter of the given rules, as add() takes them.
+     * @param rules The names to remove, or prefixes of them ending in '*'.
+     */
+    ParamFilter(std::initializer_list<std::string_view> rules);
+    ~ParamFilter();
+
+    ParamFilter(ParamFilter&& other) noexcept;
+    ParamFilter& operator=(ParamFilter&& other) noexcept;
+    ParamFilter(const ParamFilter&) = delete;
+    ParamFilter& operator=(const ParamFilter&) = delete;
+
+    /**
+     * @brief Remove the parameters named `rule`, or, if it ends in '*', every
+     * parameter whose name starts with the rest of it, as "utm_*".
+     * @param rule The name or prefix rule.
+     * @return This filter.
+     */
+    ParamFilter& add(std::string_view rule);
+
+    /**
+     * @brief Remove the parameters for which `predicate` returns true.
+     * @param predicate The test, asked only about the parameters that no
+     * name or prefix matched.
+     * @return This filter.
+     */
+    ParamFilter& predicate(Predicate predicate);
+
+    /**
+     * @brief Check whether a parameter is removed.
+     * @param name The name of the parameter.
+     * @param value The value of the parameter.
+     * @return true if this filter removes it.
+     */
+    bool matches(std::string_view name, std::string_view value) const;
+
+   private:
+    friend class Url;
+    class Impl;
+    std::unique_ptr<Impl> impl;
+};
 
 /**
  * @brief Represents a URL.
@@ -63,6 +381,14 @@ class Host;
  * The Url class provides functionalities for parsing and managing URLs. It
  * allows access to various components of a URL such as protocol, subdomain,
  * domain, suffix, query, fragment, userinfo, port, and parameters.
+ *
+ * A Url keeps a single copy of the URL. The *View() accessors return
+ * std::string_view into that copy, valid as long as the Url, or any copy of it,
+ * is alive; the accessors returning strings copy a component out of it the
+ * first time one is asked for.
+ *
+ * Copies share the parsed URL, and the host decomposition made the first time
+ * one of them asks for it, so copies can be read from several threads at once.
  */
 class Url {
    public:
@@ -79,6 +405,37 @@ class Url {
      */
     static std::string extractHost(const std::string& url) noexcept;
 
+    /**
+     * @brief Parse a URL without throwing on malformed input.
+     * @param url The URL string to parse.
+     * @param ignore_www Whether to ignore the "www" subdomain. Default is false.
+     * @return The parsed Url, or the reason the URL is malformed.
+     */
+    static Result<Url> parse(std::string_view url,
+                             const bool ignore_www = DEFAULT_IGNORE_WWW);
+
+    /**
+     * @brief Parse a URL with the PSL and options of a Context, without throwing
+     * on malformed input.
+     * @param url The URL string to parse.
+     * @param context The Context to use; it must outlive the Url.
+     * @return The parsed Url, or the reason the URL is malformed.
+     */
+    static Result<Url> parse(std::string_view url, const Context& context);
+
+    /**
+     * @brief Parse a URL with the PSL and options of a Context, allocating from
+     * an arena, without throwing on malformed input.
+     * @param url The URL string to parse.
+     * @param context The Context to use; it must outlive the Url.
+     * @param arena The memory resource to allocate from; it must outlive the Url
+     * and every copy of it.
+     * @return The parsed Url, or the reason the URL is malformed.
+     */
+    static Result<Url> parse(std::string_view url,
+                             const Context& context,
+                             std::pmr::memory_resource& arena);
+
    public:
     /**
      * @brief Construct a Url object from a given URL string.
@@ -87,6 +444,42 @@ class Url {
      * @throws std::invalid_argument If the URL is malformed or cannot be parsed.
      */
     Url(const std::string& url, const bool ignore_www = DEFAULT_IGNORE_WWW);
+
+    /**
+     * @brief Construct a Url object using the PSL and options of a Context.
+     * @param url The URL string to parse.
+     * @param context The Context to use; it must outlive this object.
+     * @throws std::invalid_argument If the URL is malformed or cannot be parsed.
+     */
+    Url(const std::string& url, const Context& context);
+
+    /**
+     * @brief Construct a Url object whose storage comes from an arena.
+     *
+     * The Url, its copy of the URL and, once it is asked for, its Host are
+     * allocated from `arena`, typically a std::pmr::monotonic_buffer_resource that
+     * is released in bulk after a batch. The arena must outlive the Url and every
+     * copy of it.
+     * @param url The URL string to parse.
+     * @param arena The memory resource to allocate from.
+     * @param ignore_www Whether to ignore the "www" subdomain. Default is false.
+     * @throws std::invalid_argument If the URL is malformed or cannot be parsed.
+     */
+    Url(std::string_view url,
+        std::pmr::memory_resource& arena,
+        const bool ignore_www = DEFAULT_IGNORE_WWW);
+
+    /**
+     * @brief Construct a Url object using a Context, with storage from an arena.
+     * @param url The URL string to parse.
+     * @param context The Context to use; it must outlive this object.
+     * @param arena The memory resource to allocate from; it must outlive this
+     * object and every copy of it.
+     * @throws std::invalid_argument If the URL is malformed or cannot be parsed.
+     */
+    Url(std::string_view url,
+        const Context& context,
+        std::pmr::memory_resource& arena);
     
     /**
      * @brief Default constructor for the Url class.
@@ -106,12 +499,26 @@ class Url {
      * @return The complete URL string.
      */
     std::string str() const noexcept;
+
+    /**
+     * @brief Get the complete URL without copying it.
+     *
+     * The string is built on the first call and shared by the copies of this Url.
+     * @return A view of the complete URL string.
+     */
+    std::string_view strView() const noexcept;
     
     /**
      * @brief Get the protocol of the URL.
      * @return The protocol of the URL (e.g., "http", "https", "ftp").
      */
     const std::string& protocol() const noexcept;
+
+    /**
+     * @brief Get the protocol of the URL without copying it.
+     * @return A view of the protocol of the URL.
+     */
+    std::string_view protocolView() const noexcept;
     
     /**
      * @brief Get the subdomain of the URL.
@@ -136,24 +543,86 @@ class Url {
      * @return The query string of the URL (e.g., "param1=value1&param2=value2").
      */
     const std::string& query() const noexcept;
+
+    /**
+     * @brief Get the query string of the URL without copying it.
+     * @return A view of the query string of the URL.
+     */
+    std::string_view queryView() const noexcept;
     
     /**
      * @brief Get the fragment part of the URL.
      * @return The fragment of the URL (the part after #).
      */
     const std::string& fragment() const noexcept;
+
+    /**
+     * @brief Get the fragment of the URL without copying it.
+     * @return A view of the fragment of the URL.
+     */
+    std::string_view fragmentView() const noexcept;
     
     /**
      * @brief Get the userinfo part of the URL.
      * @return The userinfo of the URL (e.g., "username:password").
      */
     const std::string& userinfo() const noexcept;
+
+    /**
+     * @brief Get the userinfo of the URL without copying it.
+     * @return A view of the userinfo of the URL.
+     */
+    std::string_view userinfoView() const noexcept;
     
     /**
-     * @brief Get the absolute path of the URL.
-     * @return The absolute path of the URL (the part after the host and before the query).
+     * @brief Get the URL with the "." and ".." segments of its path resolved.
+     *
+     * The Url itself is not changed.
+     * @return The URL string, with its path normalized.
      */
     std::string abspath() const noexcept;
+
+    /**
+     * @brief Get the path of the URL with its "." and ".." segments resolved and
+     * its empty segments dropped, as in "/a/b/../c" to "/a/c".
+     *
+     * The Url itself is not changed.
+     * @return The normalized path, which is "/" for an empty path.
+     */
+    std::string normalizedPath() const noexcept;
+
+    /**
+     * @brief Get a copy of the URL without the query and params parameters
+     * that `filter` matches.
+     *
+     * The Url itself is not changed.
+     * @param filter The parameters to remove.
+     * @return The URL without them.
+     */
+    Url deparam(const ParamFilter& filter) const;
+
+    /**
+     * @brief Get the URL in canonical form, for comparing or deduplicating URLs.
+     *
+     * All the selected normalizations are applied in one pass that writes the
+     * result once; the Url itself is not changed.
+     * @param options The Canonical::Option values to apply, combined with |.
+     * @return The canonical URL string.
+     */
+    std::string canonicalize(
+        unsigned options = Canonical::Equivalence) const noexcept;
+
+    /**
+     * @brief Get a 64-bit fingerprint of the canonical form, for deduplicating URLs.
+     *
+     * The fingerprint is the XXH64 hash of canonicalize(options) under seed, but
+     * it is computed without building that string.
+     * @param options The Canonical::Option values to apply, combined with |.
+     * @param seed The XXH64 seed.
+     * @return The fingerprint.
+     */
+    uint64_t fingerprint(unsigned options = Canonical::Equivalence,
+                         uint64_t seed = 0) const noexcept;
     
     /**
      * @brief Get the domain name of the URL.
@@ -166,6 +635,12 @@ class Url {
      * @return The full domain of the URL (e.g., "example.com").
      */
     const std::string& fulldomain() const noexcept;
+
+    /**
+     * @brief Get the full domain of the URL without copying it.
+     * @return A view of the full domain of the URL.
+     */
+    std::string_view fulldomainView() const noexcept;
     
     /**
      * @brief Get the port of the URL.
@@ -186,6 +661,16 @@ class Url {
     const Host& host() const;
 
    private:
+    Url(std::string_view url,
+        const bool ignore_www,
+        const Context& context,
+        std::pmr::memory_resource* resource);
+
+    static Result<Url> parse(std::string_view url,
+                             const bool ignore_www,
+                             const Context& context,
+                             std::pmr::memory_resource* resource);
+
     class Impl;
     std::shared_ptr<Impl> impl; // since all methods are constants
 };
@@ -221,6 +706,14 @@ class Host {
      * @throws std::runtime_error If the content cannot be parsed.
      */
     static void loadPslFromString(const std::string& filestr);
+
+    /**
+     * @brief Map a binary PSL snapshot and use it in place.
+     * @param filepath Path to a snapshot written by Url::PSL::saveBinary.
+     * @throws std::invalid_argument If the file cannot be mapped or is not a
+     * compatible snapshot.
+     */
+    static void loadPslFromBinary(const std::string& filepath);
     
     /**
      * @brief Check if the Public Suffix List (PSL) is loaded.
@@ -235,6 +728,24 @@ class Host {
      */
     static std::string_view removeWWW(const std::string_view& host) noexcept;
 
+    /**
+     * @brief Parse a hostname without throwing on malformed input.
+     * @param host The hostname to parse.
+     * @param ignore_www Whether to ignore the "www" subdomain. Default is false.
+     * @return The parsed Host, or the reason the hostname is malformed.
+     */
+    static Result<Host> parse(std::string_view host,
+                              const bool ignore_www = DEFAULT_IGNORE_WWW);
+
+    /**
+     * @brief Parse a hostname with the PSL and options of a Context, without
+     * throwing on malformed input.
+     * @param host The hostname to parse.
+     * @param context The Context to use.
+     * @return The parsed Host, or the reason the hostname is malformed.
+     */
+    static Result<Host> parse(std::string_view host, const Context& context);
+
    public:
     /**
      * @brief Construct a Host object from a hostname string.
@@ -243,6 +754,38 @@ class Host {
      * @throws std::invalid_argument If the hostname is malformed or cannot be parsed.
      */
     Host(const std::string& host, const bool ignore_www = DEFAULT_IGNORE_WWW);
+
+    /**
+     * @brief Construct a Host object using the PSL and options of a Context.
+     * @param host The hostname to parse.
+     * @param context The Context to use.
+     * @throws std::invalid_argument If the hostname is malformed or cannot be parsed.
+     */
+    Host(const std::string& host, const Context& context);
+
+    /**
+     * @brief Construct a Host object whose storage comes from an arena.
+     * @param host The hostname to parse.
+     * @param arena The memory resource to allocate from; it must outlive this
+     * object and every copy of it.
+     * @param ignore_www Whether to ignore the "www" subdomain. Default is false.
+     * @throws std::invalid_argument If the hostname is malformed or cannot be parsed.
+     */
+    Host(std::string_view host,
+         std::pmr::memory_resource& arena,
+         const bool ignore_www = DEFAULT_IGNORE_WWW);
+
+    /**
+     * @brief Construct a Host object using a Context, with storage from an arena.
+     * @param host The hostname to parse.
+     * @param context The Context to use.
+     * @param arena The memory resource to allocate from; it must outlive this
+     * object and every copy of it.
+     * @throws std::invalid_argument If the hostname is malformed or cannot be parsed.
+     */
+    Host(std::string_view host,
+         const Context& context,
+         std::pmr::memory_resource& arena);
     
     /**
      * @brief Default constructor for the Host class.
@@ -293,6 +836,13 @@ class Host {
      * @return The full domain of the host (e.g., "example.com").
      */
     const std::string& fulldomain() const noexcept;
+
+    /**
+     * @brief Get the full domain of the host without copying it.
+     * @return A view of the full domain, valid as long as the Host or a copy
+     * of it.
+     */
+    std::string_view fulldomainView() const noexcept;
     
     /**
      * @brief Get the complete host as a string.
@@ -300,7 +850,27 @@ class Host {
      */
     const std::string& str() const noexcept;
 
+    /**
+     * @brief Get the complete host without copying it.
+     * @return A view of the complete host string, valid as long as the Host or
+     * a copy of it.
+     */
+    std::string_view strView() const noexcept;
+
    private:
+    friend class Url;
+    Host(std::string_view host,
+         const bool ignore_www,
+         const Context& context,
+         std::pmr::memory_resource* resource);
+
+    /// Decompose `host` into this object. A malformed host is kept whole, with
+    /// no suffix, domain or subdomain, and the reason is returned.
+    ErrorCode assign(std::string_view host,
+                     const bool ignore_www,
+                     const Context& context,
+                     std::pmr::memory_resource* resource);
+
     class Impl;
     std::shared_ptr<Impl> impl; // since all methods are constants
 };
@@ -0,0 +1,29 @@
+#include "base_url.h"
+
+namespace Url
+{
+
+    BaseUrl::BaseUrl(const Url& base)
+        : base_(base), directory_(base_.path().rfind('/') + 1)
+    {
+    }
+
+    BaseUrl::BaseUrl(std::string_view base)
+        : base_(base), directory_(base_.path().rfind('/') + 1)
+    {
+    }
+
+    Url& BaseUrl::resolve(Url& url) const
+    {
+        url.resolve_relative(base_, directory_);
+        return url;
+    }
+
+    Url BaseUrl::resolve(std::string_view link, std::pmr::memory_resource* resource) const
+    {
+        Url url(link, resource);
+        resolve(url);
+        return url;
+    }
+
+}
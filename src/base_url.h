@@ -0,0 +1,66 @@
+#ifndef BASE_URL_CPP_H
+#define BASE_URL_CPP_H
+
+#include <memory_resource>
+#include <string>
+#include <string_view>
+
+#include "url.h"
+
+namespace Url
+{
+
+    /**
+     * A URL that links are resolved against, as Url::relative_to() does.
+     *
+     * The base is parsed, and the directory of its path found, once, when the BaseUrl
+     * is made; resolving a link then only parses the link and writes the result into
+     * one buffer. Make one per page and resolve all of its links with it. It is not
+     * changed by use and may be shared by threads.
+     */
+    class BaseUrl
+    {
+    public:
+        explicit BaseUrl(const Url& base);
+
+        explicit BaseUrl(std::string_view base);
+
+        const Url& url() const noexcept { return base_; }
+
+        /**
+         * Make `url` relative to the base, as url.relative_to(base) would.
+         */
+        Url& resolve(Url& url) const;
+
+        /**
+         * Parse `link` and resolve it, as Url(link).relative_to(base) would. Throws
+         * UrlParseException if `link` is malformed.
+         */
+        Url resolve(std::string_view link,
+                    std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const;
+
+        /**
+         * Resolve each link of [first, last) and write the results to `out`, stopping
+         * at the first malformed link with UrlParseException.
+         */
+        template <typename InputIt, typename OutputIt>
+        OutputIt resolve(InputIt first, InputIt last, OutputIt out,
+                         std::pmr::memory_resource* resource = std::pmr::get_default_resource()) const
+        {
+            for (; first != last; ++first)
+            {
+                *out++ = resolve(std::string_view(*first), resource);
+            }
+            return out;
+        }
+
+    private:
+        Url base_;
+        // The length of the directory of the base's path, up to and including its
+        // last '/', or 0
+        size_t directory_;
+    };
+
+}
+
+#endif
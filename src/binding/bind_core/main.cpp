@@ -1,5 +1,6 @@
 #include <nanobind/nanobind.h>
 #include <nanobind/stl/string.h>
+#include <nanobind/stl/string_view.h>
 #include <nanobind/stl/vector.h>
 
 #include <string>
@@ -98,9 +99,9 @@ NB_MODULE(NB_MODULE_NAME, m) {
         .def_static("extract_from_url", extract_from_url, nb::arg("urlstr"))
         .def_static("extract", extract, nb::arg("hoststr"))
         .def_static("load_psl_from_path", &TLD::Host::loadPslFromPath,
-                    nb::arg("filepath"))
+                    nb::arg("filepath"), nb::call_guard<nb::gil_scoped_release>())
         .def_static("load_psl_from_string", &TLD::Host::loadPslFromString,
-                    nb::arg("string"))
+                    nb::arg("string"), nb::call_guard<nb::gil_scoped_release>())
         .def_static("is_psl_loaded", &TLD::Host::isPslLoaded)
         .def_static("removeWWW", &TLD::Host::removeWWW, nb::arg("hoststr"))
         .def_prop_ro("subdomain", &TLD::Host::subdomain)
@@ -144,8 +145,10 @@ NB_MODULE(NB_MODULE_NAME, m) {
        .def_prop_ro("url", &Psl::url)
        .def_prop_ro("filename", &Psl::filename)
        .def("is_loaded", &Psl::isLoaded, "check whether psl is loaded or not")
-       .def("load_from_path", &Psl::loadFromPath, nb::arg("filepath"), "load PSL from path")
-       .def("load_from_string", &Psl::loadFromString, nb::arg("string"), "load PSL from string")
+       .def("load_from_path", &Psl::loadFromPath, nb::arg("filepath"), "load PSL from path",
+            nb::call_guard<nb::gil_scoped_release>())
+       .def("load_from_string", &Psl::loadFromString, nb::arg("string"), "load PSL from string",
+            nb::call_guard<nb::gil_scoped_release>())
        .def("__repr__", [](const Psl& p) -> std::string {
             return std::string("<PSL : ") + (p.isLoaded() ? "loaded" : "not loaded") + ">";
         });
@@ -0,0 +1,183 @@
+#ifndef CHARACTER_CLASS_CPP_H
+#define CHARACTER_CLASS_CPP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Url
+{
+
+    /**
+     * The character classes of RFC 3986, computed at compile time.
+     *
+     * Every byte has one entry in a 256-entry table whose bits say which classes
+     * it belongs to, so any class, or any union of classes, is tested with one load
+     * and one mask.
+     */
+    namespace Characters
+    {
+        enum Class : uint16_t
+        {
+            GenDelims  = 1 << 0,
+            SubDelims  = 1 << 1,
+            Alpha      = 1 << 2,
+            Digit      = 1 << 3,
+            Unreserved = 1 << 4,
+            Reserved   = 1 << 5,
+            Pchar      = 1 << 6,
+            Path       = 1 << 7,
+            Query      = 1 << 8,
+            Fragment   = 1 << 9,
+            Userinfo   = 1 << 10,
+            Hex        = 1 << 11,
+            Scheme     = 1 << 12,
+            // The delimiters the tokenizer splits on, see Scan
+            Delimiter  = 1 << 13
+        };
+
+        static constexpr std::string_view gen_delims = ":/?#[]@";
+        static constexpr std::string_view sub_delims = "!$&'()*+,;=";
+        static constexpr std::string_view alpha =
+            "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+        static constexpr std::string_view digit = "0123456789";
+        static constexpr std::string_view hex = "0123456789ABCDEF";
+        static constexpr std::string_view delimiters = ":/?#@;";
+
+        struct Table
+        {
+            uint16_t classes[256] = {};
+
+            constexpr Table()
+            {
+                add(gen_delims, GenDelims | Reserved);
+                add(sub_delims, SubDelims | Reserved | Pchar | Userinfo);
+                add(alpha, Alpha | Unreserved | Pchar | Userinfo | Scheme);
+                add(digit, Digit | Unreserved | Pchar | Userinfo | Scheme);
+                add("-._~", Unreserved | Pchar | Userinfo);
+                add(":@", Pchar);
+                add(":", Userinfo);
+                add(hex, Hex);
+                add("+-.", Scheme);
+                add(delimiters, Delimiter);
+
+                // Paths, queries and fragments are pchars plus a few more
+                for (size_t index = 0; index < 256; ++index)
+                {
+                    if (classes[index] & Pchar)
+                    {
+                        classes[index] |= Path | Query | Fragment;
+                    }
+                }
+                add("/", Path | Query | Fragment);
+                add("?", Query | Fragment);
+            }
+
+            constexpr void add(std::string_view chars, uint16_t mask)
+            {
+                for (char c : chars)
+                {
+                    classes[static_cast<unsigned char>(c)] |= mask;
+                }
+            }
+        };
+
+        static constexpr Table table;
+
+        /**
+         * Whether `c` belongs to any of the classes in `mask`.
+         */
+        constexpr bool is(char c, uint16_t mask) noexcept
+        {
+            return (table.classes[static_cast<unsigned char>(c)] & mask) != 0;
+        }
+
+        struct HexTable
+        {
+            int8_t values[256] = {};
+
+            constexpr HexTable()
+            {
+                for (size_t index = 0; index < 256; ++index)
+                {
+                    values[index] = -1;
+                }
+                for (int value = 0; value < 16; ++value)
+                {
+                    values[static_cast<unsigned char>(hex[value])] = value;
+                    values[static_cast<unsigned char>("0123456789abcdef"[value])] = value;
+                }
+            }
+        };
+
+        static constexpr HexTable hex_table;
+
+        /**
+         * The value of a hex digit of either case, or -1 if `c` is not one.
+         */
+        constexpr int hexValue(char c) noexcept
+        {
+            return hex_table.values[static_cast<unsigned char>(c)];
+        }
+    }
+
+    /**
+     * A predicate testing membership in one or more of the Characters classes.
+     */
+    struct CharacterClass
+    {
+        constexpr explicit CharacterClass(uint16_t mask) : mask_(mask)
+        {
+            for (size_t index = 0; index < 256; ++index)
+            {
+                if (Characters::table.classes[index] & mask)
+                {
+                    if (index < 0x80)
+                    {
+                        nibbles_[index % 16] |= static_cast<uint8_t>(1 << (index / 16));
+                    }
+                    else
+                    {
+                        ascii_ = false;
+                    }
+                }
+            }
+        }
+
+        constexpr bool operator()(char c) const noexcept
+        {
+            return Characters::is(c, mask_);
+        }
+
+        constexpr uint16_t mask() const noexcept
+        {
+            return mask_;
+        }
+
+        /**
+         * The members below 0x80 as a table indexed by their low nibble: bit h of
+         * nibbles()[l] is set if the byte 16 * h + l is a member. Vector kernels
+         * classify 16 bytes at a time with two byte shuffles of it.
+         */
+        constexpr const uint8_t* nibbles() const noexcept
+        {
+            return nibbles_;
+        }
+
+        /**
+         * Whether every member is below 0x80, so that nibbles() covers them all.
+         */
+        constexpr bool ascii() const noexcept
+        {
+            return ascii_;
+        }
+
+    private:
+        uint16_t mask_;
+        uint8_t nibbles_[16] = {};
+        bool ascii_ = true;
+    };
+
+}
+
+#endif
@@ -0,0 +1,179 @@
+#ifndef HASH64_CPP_H
+#define HASH64_CPP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace Url
+{
+
+    /**
+     * XXH64 of bytes given a few at a time.
+     *
+     * Bytes are gathered into 32-byte stripes, each folded into four lanes as soon
+     * as it is full, so the input is never held as a whole. The digest is the same
+     * as the one XXH64 gives for all the bytes at once, which hash() computes.
+     */
+    class Hash64
+    {
+    public:
+        explicit Hash64(uint64_t seed = 0) noexcept
+            : lanes_{seed + prime1 + prime2, seed + prime2, seed, seed - prime1},
+              seed_(seed), total_(0), buffered_(0)
+        {
+        }
+
+        void put(char c) noexcept
+        {
+            stripe_[buffered_++] = static_cast<unsigned char>(c);
+            if (buffered_ == stripe_size)
+            {
+                consume(stripe_);
+                buffered_ = 0;
+            }
+            ++total_;
+        }
+
+        void append(std::string_view text) noexcept
+        {
+            const unsigned char* data = reinterpret_cast<const unsigned char*>(text.data());
+            size_t size = text.size();
+            total_ += size;
+
+            if (buffered_ != 0)
+            {
+                size_t fill = stripe_size - buffered_;
+                if (size < fill)
+                {
+                    std::memcpy(stripe_ + buffered_, data, size);
+                    buffered_ += size;
+                    return;
+                }
+                std::memcpy(stripe_ + buffered_, data, fill);
+                consume(stripe_);
+                buffered_ = 0;
+                data += fill;
+                size -= fill;
+            }
+
+            // Whole stripes straight from the input
+            for (; size >= stripe_size; data += stripe_size, size -= stripe_size)
+            {
+                consume(data);
+            }
+            std::memcpy(stripe_, data, size);
+            buffered_ = size;
+        }
+
+        uint64_t digest() const noexcept
+        {
+            uint64_t hash;
+            if (total_ >= stripe_size)
+            {
+                hash = rotl(lanes_[0], 1) + rotl(lanes_[1], 7) + rotl(lanes_[2], 12)
+                    + rotl(lanes_[3], 18);
+                for (uint64_t lane : lanes_)
+                {
+                    hash = (hash ^ round(0, lane)) * prime1 + prime4;
+                }
+            }
+            else
+            {
+                hash = seed_ + prime5;
+            }
+            hash += total_;
+
+            const unsigned char* tail = stripe_;
+            size_t size = buffered_;
+            for (; size >= 8; tail += 8, size -= 8)
+            {
+                hash ^= round(0, read64(tail));
+                hash = rotl(hash, 27) * prime1 + prime4;
+            }
+            if (size >= 4)
+            {
+                hash ^= static_cast<uint64_t>(read32(tail)) * prime1;
+                hash = rotl(hash, 23) * prime2 + prime3;
+                tail += 4;
+                size -= 4;
+            }
+            for (; size > 0; ++tail, --size)
+            {
+                hash ^= *tail * prime5;
+                hash = rotl(hash, 11) * prime1;
+            }
+
+            hash ^= hash >> 33;
+            hash *= prime2;
+            hash ^= hash >> 29;
+            hash *= prime3;
+            hash ^= hash >> 32;
+            return hash;
+        }
+
+        /**
+         * XXH64 of `text`.
+         */
+        static uint64_t hash(std::string_view text, uint64_t seed = 0) noexcept
+        {
+            Hash64 hasher(seed);
+            hasher.append(text);
+            return hasher.digest();
+        }
+
+    private:
+        static constexpr uint64_t prime1 = 0x9E3779B185EBCA87ULL;
+        static constexpr uint64_t prime2 = 0xC2B2AE3D27D4EB4FULL;
+        static constexpr uint64_t prime3 = 0x165667B19E3779F9ULL;
+        static constexpr uint64_t prime4 = 0x85EBCA77C2B2AE63ULL;
+        static constexpr uint64_t prime5 = 0x27D4EB2F165667C5ULL;
+        static constexpr size_t stripe_size = 32;
+
+        static uint64_t rotl(uint64_t value, int bits) noexcept
+        {
+            return (value << bits) | (value >> (64 - bits));
+        }
+
+        static uint64_t round(uint64_t lane, uint64_t input) noexcept
+        {
+            lane += input * prime2;
+            return rotl(lane, 31) * prime1;
+        }
+
+        // XXH64 reads its input as little-endian words
+        static uint64_t read64(const unsigned char* data) noexcept
+        {
+            uint64_t value = 0;
+            for (int index = 7; index >= 0; --index)
+            {
+                value = (value << 8) | data[index];
+            }
+            return value;
+        }
+
+        static uint32_t read32(const unsigned char* data) noexcept
+        {
+            return static_cast<uint32_t>(data[0]) | (static_cast<uint32_t>(data[1]) << 8)
+                | (static_cast<uint32_t>(data[2]) << 16) | (static_cast<uint32_t>(data[3]) << 24);
+        }
+
+        void consume(const unsigned char* stripe) noexcept
+        {
+            for (size_t lane = 0; lane < 4; ++lane)
+            {
+                lanes_[lane] = round(lanes_[lane], read64(stripe + 8 * lane));
+            }
+        }
+
+        uint64_t lanes_[4];
+        uint64_t seed_;
+        uint64_t total_;
+        size_t buffered_;
+        unsigned char stripe_[stripe_size];
+    };
+
+}
+
+#endif
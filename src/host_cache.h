@@ -0,0 +1,244 @@
+#ifndef HOST_CACHE_CPP_H
+#define HOST_CACHE_CPP_H
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace Url
+{
+
+    /**
+     * A bounded map from (hostname, flag) to a Value, shared by many threads.
+     *
+     * Keys are spread over a fixed number of shards, each guarded by its own
+     * reader/writer lock, so hits on different shards never contend and hits on the
+     * same shard only share a lock. Each shard evicts with the CLOCK algorithm: a
+     * hit only sets the reference bit of its slot, and the eviction hand clears bits
+     * until it finds a slot that was not used since its last pass.
+     *
+     * A capacity of 0 disables the cache; lookups then miss without locking.
+     */
+    template <typename Value>
+    class HostCache
+    {
+    public:
+        static constexpr size_t shard_count = 16;
+
+        explicit HostCache(size_t capacity = 0) { resize(capacity); }
+
+        HostCache(const HostCache&) = delete;
+        HostCache& operator=(const HostCache&) = delete;
+
+        /**
+         * Copy the value cached for `host` into `value`. Returns whether it was found.
+         */
+        bool lookup(std::string_view host, bool flag, Value& value) const
+        {
+            if (capacity_.load(std::memory_order_relaxed) == 0)
+            {
+                return false;
+            }
+
+            size_t hash = hashKey(host, flag);
+            const Shard& shard = shards[hash % shard_count];
+            std::shared_lock<std::shared_mutex> lock(shard.mutex);
+            auto found = shard.index.find(Key{host, flag});
+            if (found == shard.index.end())
+            {
+                shard.misses.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+
+            Slot& slot = shard.slots[found->second];
+            slot.referenced.store(true, std::memory_order_relaxed);
+            value = slot.value;
+            shard.hits.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+
+        /**
+         * The generation to pass to insert(). Take it before computing the value, so
+         * that values computed before a clear() are not inserted after it.
+         */
+        uint64_t generation() const noexcept
+        {
+            return generation_.load(std::memory_order_acquire);
+        }
+
+        /**
+         * Cache `value` for `host`, evicting another entry of its shard when full.
+         */
+        void insert(std::string_view host, bool flag, const Value& value,
+                    uint64_t generation)
+        {
+            if (capacity_.load(std::memory_order_relaxed) == 0)
+            {
+                return;
+            }
+
+            size_t hash = hashKey(host, flag);
+            Shard& shard = shards[hash % shard_count];
+            std::unique_lock<std::shared_mutex> lock(shard.mutex);
+            if (generation != generation_.load(std::memory_order_relaxed) ||
+                shard.capacity == 0 ||
+                shard.index.find(Key{host, flag}) != shard.index.end())
+            {
+                return;
+            }
+
+            size_t position;
+            if (shard.size < shard.capacity)
+            {
+                position = shard.size++;
+            }
+            else
+            {
+                // Give every recently used slot a second chance
+                while (shard.slots[shard.hand].referenced.load(std::memory_order_relaxed))
+                {
+                    shard.slots[shard.hand].referenced.store(false, std::memory_order_relaxed);
+                    shard.hand = (shard.hand + 1) % shard.capacity;
+                }
+                position = shard.hand;
+                shard.hand = (shard.hand + 1) % shard.capacity;
+                const Slot& evicted = shard.slots[position];
+                shard.index.erase(Key{evicted.host, evicted.flag});
+            }
+
+            Slot& slot = shard.slots[position];
+            slot.host.assign(host.data(), host.size());
+            slot.flag = flag;
+            slot.value = value;
+            slot.referenced.store(false, std::memory_order_relaxed);
+            // The key views the host owned by the slot
+            shard.index.emplace(Key{slot.host, flag}, position);
+        }
+
+        /**
+         * Drop every entry.
+         */
+        void clear()
+        {
+            resize(capacity_.load(std::memory_order_relaxed));
+        }
+
+        /**
+         * Drop every entry and bound the cache to about `capacity` entries.
+         */
+        void resize(size_t capacity)
+        {
+            std::lock_guard<std::mutex> guard(resizing);
+            size_t per_shard = (capacity + shard_count - 1) / shard_count;
+            for (Shard& shard : shards)
+            {
+                std::unique_lock<std::shared_mutex> lock(shard.mutex);
+                shard.index.clear();
+                shard.slots.reset(per_shard ? new Slot[per_shard] : nullptr);
+                shard.capacity = per_shard;
+                shard.size = 0;
+                shard.hand = 0;
+            }
+            generation_.fetch_add(1, std::memory_order_release);
+            capacity_.store(per_shard * shard_count, std::memory_order_relaxed);
+        }
+
+        size_t capacity() const noexcept
+        {
+            return capacity_.load(std::memory_order_relaxed);
+        }
+
+        size_t size() const
+        {
+            size_t total = 0;
+            for (const Shard& shard : shards)
+            {
+                std::shared_lock<std::shared_mutex> lock(shard.mutex);
+                total += shard.size;
+            }
+            return total;
+        }
+
+        uint64_t hits() const noexcept
+        {
+            return sum(&Shard::hits);
+        }
+
+        uint64_t misses() const noexcept
+        {
+            return sum(&Shard::misses);
+        }
+
+    private:
+        struct Key
+        {
+            std::string_view host;
+            bool flag;
+
+            bool operator==(const Key& other) const noexcept
+            {
+                return flag == other.flag && host == other.host;
+            }
+        };
+
+        static size_t hashKey(std::string_view host, bool flag) noexcept
+        {
+            return std::hash<std::string_view>()(host) ^ static_cast<size_t>(flag);
+        }
+
+        struct KeyHash
+        {
+            size_t operator()(const Key& key) const noexcept
+            {
+                // Shards take the low bits, so mix them out of the index's buckets
+                return hashKey(key.host, key.flag) / shard_count;
+            }
+        };
+
+        struct Slot
+        {
+            std::string host;
+            bool flag = false;
+            Value value{};
+            std::atomic<bool> referenced{false};
+        };
+
+        // Padded so that the counters of neighbouring shards do not share a line
+        struct alignas(64) Shard
+        {
+            mutable std::shared_mutex mutex;
+            std::unordered_map<Key, size_t, KeyHash> index;
+            std::unique_ptr<Slot[]> slots;
+            size_t capacity = 0;
+            size_t size = 0;
+            size_t hand = 0;
+            mutable std::atomic<uint64_t> hits{0};
+            mutable std::atomic<uint64_t> misses{0};
+        };
+
+        uint64_t sum(std::atomic<uint64_t> Shard::*counter) const noexcept
+        {
+            uint64_t total = 0;
+            for (const Shard& shard : shards)
+            {
+                total += (shard.*counter).load(std::memory_order_relaxed);
+            }
+            return total;
+        }
+
+        Shard shards[shard_count];
+        std::atomic<size_t> capacity_{0};
+        std::atomic<uint64_t> generation_{0};
+        std::mutex resizing;
+    };
+
+}
+
+#endif
@@ -0,0 +1,103 @@
+#ifndef LAZY_CPP_H
+#define LAZY_CPP_H
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <utility>
+
+namespace Url
+{
+
+    /**
+     * A value derived from an object on first use, and kept until the object changes.
+     *
+     * Readers that share the object may ask for the value from several threads at
+     * once: the first one builds it and publishes it with a release store, the
+     * others wait for it, and once it is published every read costs one acquire
+     * load. Resetting is a change to the object, so it must not overlap with reads.
+     *
+     * Copies start out empty, since the value belongs to the object it was made from.
+     */
+    template <typename T>
+    class Lazy
+    {
+    public:
+        Lazy() = default;
+
+        Lazy(const Lazy&) noexcept : value_(), state_(Empty) {}
+
+        Lazy& operator=(const Lazy&) noexcept
+        {
+            reset();
+            return *this;
+        }
+
+        /**
+         * The value, built by `make(T&)` if it is not there yet.
+         */
+        template <typename Make>
+        const T& get(Make&& make) const
+        {
+            if (state_.load(std::memory_order_acquire) != Ready)
+            {
+                build(std::forward<Make>(make));
+            }
+            return value_;
+        }
+
+        /**
+         * Forget the value; the next get() builds it again into the same storage.
+         */
+        void reset() noexcept
+        {
+            state_.store(Empty, std::memory_order_relaxed);
+        }
+
+    private:
+        enum State : uint8_t
+        {
+            Empty,
+            Building,
+            Ready
+        };
+
+        template <typename Make>
+        void build(Make&& make) const
+        {
+            uint8_t expected = Empty;
+            if (state_.compare_exchange_strong(expected, Building, std::memory_order_acquire))
+            {
+                try
+                {
+                    make(value_);
+                }
+                catch (...)
+                {
+                    state_.store(Empty, std::memory_order_release);
+                    throw;
+                }
+                state_.store(Ready, std::memory_order_release);
+                return;
+            }
+
+            // Building a value takes well under a microsecond
+            while ((expected = state_.load(std::memory_order_acquire)) != Ready)
+            {
+                if (expected == Empty)
+                {
+                    // The builder failed; try ourselves
+                    build(std::forward<Make>(make));
+                    return;
+                }
+                std::this_thread::yield();
+            }
+        }
+
+        mutable T value_{};
+        mutable std::atomic<uint8_t> state_{Empty};
+    };
+
+}
+
+#endif
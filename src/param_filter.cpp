@@ -0,0 +1,152 @@
+#include <algorithm>
+#include <utility>
+
+#include "param_filter.h"
+
+namespace Url
+{
+
+    namespace
+    {
+        char lower(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
+        }
+
+        std::string lowered(std::string_view text)
+        {
+            std::string result(text);
+            std::transform(result.begin(), result.end(), result.begin(), lower);
+            return result;
+        }
+
+        // Whether `text` is `lowercase` in any case
+        bool equalsLowered(std::string_view text, std::string_view lowercase)
+        {
+            if (text.size() != lowercase.size())
+            {
+                return false;
+            }
+            for (size_t index = 0; index < text.size(); ++index)
+            {
+                if (lower(text[index]) != lowercase[index])
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+    }
+
+    ParamFilter::ParamFilter(std::initializer_list<std::string_view> rules)
+    {
+        for (std::string_view rule : rules)
+        {
+            add(rule);
+        }
+    }
+
+    ParamFilter& ParamFilter::add(std::string_view rule)
+    {
+        if (!rule.empty() && rule.back() == '*')
+        {
+            return prefix(rule.substr(0, rule.size() - 1));
+        }
+        return name(rule);
+    }
+
+    ParamFilter& ParamFilter::name(std::string_view name)
+    {
+        if (!hasName(name))
+        {
+            names_.push_back(lowered(name));
+            rehash();
+        }
+        return *this;
+    }
+
+    ParamFilter& ParamFilter::prefix(std::string_view prefix)
+    {
+        prefixes_.push_back(lowered(prefix));
+        return *this;
+    }
+
+    ParamFilter& ParamFilter::predicate(Predicate predicate)
+    {
+        predicates_.push_back(std::move(predicate));
+        return *this;
+    }
+
+    bool ParamFilter::matches(std::string_view name, std::string_view value) const
+    {
+        if (hasName(name))
+        {
+            return true;
+        }
+        for (const std::string& prefix : prefixes_)
+        {
+            if (equalsLowered(name.substr(0, prefix.size()), prefix))
+            {
+                return true;
+            }
+        }
+        for (const Predicate& predicate : predicates_)
+        {
+            if (predicate(name, value))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    uint64_t ParamFilter::hash(std::string_view name) noexcept
+    {
+        // FNV-1a over the lowercased bytes
+        uint64_t hash = 0xcbf29ce484222325ULL;
+        for (char c : name)
+        {
+            hash ^= static_cast<unsigned char>(lower(c));
+            hash *= 0x100000001b3ULL;
+        }
+        return hash;
+    }
+
+    bool ParamFilter::hasName(std::string_view name) const noexcept
+    {
+        if (slots_.empty())
+        {
+            return false;
+        }
+        size_t mask = slots_.size() - 1;
+        for (size_t slot = hash(name) & mask; slots_[slot] != 0; slot = (slot + 1) & mask)
+        {
+            if (equalsLowered(name, names_[slots_[slot] - 1]))
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    void ParamFilter::rehash()
+    {
+        // At most half full, so that probes stay short
+        size_t size = 8;
+        while (size < 2 * names_.size())
+        {
+            size *= 2;
+        }
+        slots_.assign(size, 0);
+        for (size_t index = 0; index < names_.size(); ++index)
+        {
+            size_t slot = hash(names_[index]) & (size - 1);
+            while (slots_[slot] != 0)
+            {
+                slot = (slot + 1) & (size - 1);
+            }
+            slots_[slot] = static_cast<uint32_t>(index + 1);
+        }
+    }
+
+}
@@ -0,0 +1,91 @@
+#ifndef PARAM_FILTER_CPP_H
+#define PARAM_FILTER_CPP_H
+
+#include <cstdint>
+#include <functional>
+#include <initializer_list>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Url
+{
+
+    /**
+     * Which query and params pieces Url::deparam() removes, decided by their names
+     * in any case, or by a predicate.
+     *
+     * Names are kept lowercased in an open-addressing table that is hashed without
+     * regard to case, so matching a name neither copies nor lowercases it. Build a
+     * filter once and apply it to any number of URLs; it is not changed by use and
+     * may be shared by threads.
+     */
+    class ParamFilter
+    {
+    public:
+        typedef std::function<bool(std::string_view name, std::string_view value)> Predicate;
+
+        ParamFilter() = default;
+
+        /**
+         * A filter of the given rules, as add() takes them.
+         */
+        ParamFilter(std::initializer_list<std::string_view> rules);
+
+        /**
+         * Remove pieces named `rule`. A rule that ends in '*' removes every name
+         * that starts with the rest of it, as "utm_*" does.
+         */
+        ParamFilter& add(std::string_view rule);
+
+        /**
+         * Remove pieces named `name`.
+         */
+        ParamFilter& name(std::string_view name);
+
+        /**
+         * Remove pieces whose names start with `prefix`.
+         */
+        ParamFilter& prefix(std::string_view prefix);
+
+        /**
+         * Remove pieces for which `predicate` returns true. Predicates are asked
+         * only about the pieces no name or prefix matched, in the order they were
+         * added.
+         */
+        ParamFilter& predicate(Predicate predicate);
+
+        /**
+         * Whether a piece with this name and value is removed.
+         */
+        bool matches(std::string_view name, std::string_view value) const;
+
+        bool operator()(std::string_view name, std::string_view value) const
+        {
+            return matches(name, value);
+        }
+
+        bool empty() const noexcept
+        {
+            return names_.empty() && prefixes_.empty() && predicates_.empty();
+        }
+
+    private:
+        static uint64_t hash(std::string_view name) noexcept;
+
+        bool hasName(std::string_view name) const noexcept;
+
+        void rehash();
+
+        // Lowercased
+        std::vector<std::string> names_;
+        // One more than an index of names_, or 0 for a free slot; a power of two long
+        std::vector<uint32_t> slots_;
+        // Lowercased
+        std::vector<std::string> prefixes_;
+        std::vector<Predicate> predicates_;
+    };
+
+}
+
+#endif
@@ -0,0 +1,173 @@
+#ifndef PIECES_CPP_H
+#define PIECES_CPP_H
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace Url
+{
+
+    /**
+     * The pieces of a query or params, split on their glue byte, as spans of the
+     * text they came from.
+     *
+     * Up to inline_count pieces are kept in the object itself, so splitting,
+     * sorting and joining a typical query allocates nothing. The text must outlive
+     * the Pieces.
+     */
+    class Pieces
+    {
+    public:
+        static constexpr size_t inline_count = 32;
+
+        /**
+         * How sort() orders pieces.
+         */
+        enum Order : unsigned
+        {
+            // Compare only the names, the bytes before the first '='. Pieces with
+            // the same name keep their order.
+            ByName     = 1 << 0,
+            // Keep only the first piece of each name
+            UniqueName = 1 << 1
+        };
+
+        /**
+         * Split `text` on `glue`. With `skip_empty`, empty pieces are dropped, as
+         * strip() does. Otherwise only an empty last piece is, which is how
+         * std::getline splits.
+         */
+        Pieces(std::string_view text, char glue, bool skip_empty)
+            : text_(text), glue_(glue), spans_(local_), count_(0)
+        {
+            size_t most = static_cast<size_t>(std::count(text.begin(), text.end(), glue)) + 1;
+            if (most > inline_count)
+            {
+                spill_.resize(most);
+                spans_ = spill_.data();
+            }
+
+            for (size_t start = 0; start < text.size();)
+            {
+                size_t end = std::min(text.find(glue, start), text.size());
+                if (!skip_empty || end > start)
+                {
+                    spans_[count_++] = Span{
+                        static_cast<uint32_t>(start), static_cast<uint32_t>(end - start)};
+                }
+                start = end + 1;
+            }
+        }
+
+        Pieces(const Pieces&) = delete;
+        Pieces& operator=(const Pieces&) = delete;
+
+        size_t size() const noexcept { return count_; }
+
+        std::string_view operator[](size_t index) const noexcept
+        {
+            return text_.substr(spans_[index].offset, spans_[index].length);
+        }
+
+        /**
+         * The name of a piece, which is all of it when it has no '='.
+         */
+        static std::string_view name(std::string_view piece) noexcept
+        {
+            return piece.substr(0, piece.find('='));
+        }
+
+        /**
+         * Sort the pieces bytewise, or as `order` says.
+         */
+        void sort(unsigned order) noexcept
+        {
+            Span* end = spans_ + count_;
+            if (!(order & (ByName | UniqueName)))
+            {
+                std::sort(spans_, end, [this](const Span& a, const Span& b)
+                    {
+                        return view(a) < view(b);
+                    });
+                return;
+            }
+
+            // Ties are broken by position, which keeps the sort stable without the
+            // buffer std::stable_sort would allocate, or by the whole piece
+            const bool stable = (order & ByName) != 0;
+            std::sort(spans_, end, [this, stable](const Span& a, const Span& b)
+                {
+                    int names = name(view(a)).compare(name(view(b)));
+                    if (names != 0)
+                    {
+                        return names < 0;
+                    }
+                    return stable ? a.offset < b.offset : view(a) < view(b);
+                });
+
+            if (order & UniqueName)
+            {
+                end = std::unique(spans_, end, [this](const Span& a, const Span& b)
+                    {
+                        return name(view(a)) == name(view(b));
+                    });
+                count_ = static_cast<size_t>(end - spans_);
+            }
+        }
+
+        /**
+         * The length of the pieces joined with their glue.
+         */
+        size_t joinedSize() const noexcept
+        {
+            size_t size = count_ ? count_ - 1 : 0;
+            for (size_t index = 0; index < count_; ++index)
+            {
+                size += spans_[index].length;
+            }
+            return size;
+        }
+
+        /**
+         * Write the pieces joined with their glue to `out`, which has room for
+         * joinedSize() bytes.
+         */
+        void join(char* out) const noexcept
+        {
+            for (size_t index = 0; index < count_; ++index)
+            {
+                if (index != 0)
+                {
+                    *out++ = glue_;
+                }
+                std::string_view piece = (*this)[index];
+                out = std::copy(piece.begin(), piece.end(), out);
+            }
+        }
+
+    private:
+        struct Span
+        {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        std::string_view view(const Span& span) const noexcept
+        {
+            return text_.substr(span.offset, span.length);
+        }
+
+        std::string_view text_;
+        char glue_;
+        Span local_[inline_count];
+        std::vector<Span> spill_;
+        Span* spans_;
+        size_t count_;
+    };
+
+}
+
+#endif
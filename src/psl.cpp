@@ -1,19 +1,287 @@
 #include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <iostream>
+#include <limits>
+#include <map>
+#include <memory>
 #include <string>
+#include <thread>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#if defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#endif
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "psl.h"
+#include "punycode.h"
 namespace Url
 {
     const std::string PSL::not_found = "";
 
-    PSL::PSL(std::istream& stream)
+    namespace
+    {
+        // Labels of the trie are at most this long
+        constexpr size_t max_label = std::numeric_limits<uint8_t>::max();
+
+        inline void prefetch(const void* address)
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            __builtin_prefetch(address);
+#elif defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+            _mm_prefetch(static_cast<const char*>(address), _MM_HINT_T0);
+#else
+            (void)address;
+#endif
+        }
+
+        inline unsigned char lower(char c)
+        {
+            return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+        }
+
+        /**
+         * Compare a lowercased label of the trie with a label of a hostname, ignoring
+         * the case of the latter. Returns <0, 0 or >0 like memcmp.
+         */
+        inline int compareLabel(
+            const char* stored, size_t stored_length, const char* label, size_t length)
+        {
+            size_t common = std::min(stored_length, length);
+            for (size_t index = 0; index < common; ++index)
+            {
+                unsigned char left = stored[index];
+                unsigned char right = lower(label[index]);
+                if (left != right)
+                {
+                    return left < right ? -1 : 1;
+                }
+            }
+            return (stored_length < length) ? -1 : (stored_length > length);
+        }
+    }
+
+    struct PSL::Builder
+    {
+        struct Pending
+        {
+            // Sorted mapping of a label to the index of its node in `tree`
+            std::map<std::string, size_t> children;
+            uint8_t icann_level = no_rule;
+            uint8_t private_level = no_rule;
+        };
+
+        std::vector<Pending> tree = std::vector<Pending>(1);
+        size_t rules = 0;
+    };
+
+    namespace
+    {
+        // Backing store of a trie compiled at runtime
+        struct Storage
+        {
+            std::vector<PSL::Node> nodes;
+            std::string labels;
+        };
+
+        // Header of a binary snapshot. The nodes follow it, then the labels.
+        struct BinaryHeader
+        {
+            char magic[8];
+            // Written as 0x01020304 to reject snapshots of the other endianness
+            uint32_t byte_order;
+            uint32_t node_size;
+            uint64_t node_count;
+            uint64_t label_size;
+            uint64_t rules;
+        };
+
+        constexpr char binary_magic[8] = {'U', 'R', 'L', 'P', 'S', 'L', '\0', '2'};
+        constexpr uint32_t binary_byte_order = 0x01020304;
+
+        std::invalid_argument inaccessible(const std::string& path)
+        {
+            std::stringstream message;
+            message << "Path '" << path << "' is inaccessible.";
+            return std::invalid_argument(message.str());
+        }
+
+        /**
+         * Read-side state of a thread. `epoch` is odd while the thread is inside a
+         * read section. Records are padded to a cache line so that readers never
+         * share one.
+         */
+        struct alignas(64) ReaderRecord
+        {
+            std::atomic<uint64_t> epoch{0};
+            unsigned depth = 0;
+        };
+
+        // Records of all threads that have read an AtomicPSL. They are shared so
+        // that a writer can wait on them after letting go of the lock, even if
+        // their threads exit meanwhile.
+        struct ReaderRegistry
+        {
+            std::mutex mutex;
+            std::vector<std::shared_ptr<ReaderRecord>> records;
+        };
+
+        ReaderRegistry& readerRegistry()
+        {
+            // Never destroyed, since threads may exit after static destruction
+            static ReaderRegistry* registry = new ReaderRegistry();
+            return *registry;
+        }
+
+        struct ThreadReader
+        {
+            ThreadReader() : shared(std::make_shared<ReaderRecord>()), record(*shared)
+            {
+                ReaderRegistry& registry = readerRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                registry.records.push_back(shared);
+            }
+
+            ~ThreadReader()
+            {
+                ReaderRegistry& registry = readerRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                registry.records.erase(std::find(
+                    registry.records.begin(), registry.records.end(), shared));
+            }
+
+            std::shared_ptr<ReaderRecord> shared;
+            ReaderRecord& record;
+        };
+
+        ReaderRecord& threadRecord()
+        {
+            thread_local ThreadReader reader;
+            return reader.record;
+        }
+
+        /**
+         * Wait until every thread that was inside a read section has left it.
+         */
+        void waitForReaders()
+        {
+            // Wait on a copy of the registry rather than under its lock, so that
+            // threads reading for the first time, and writers to other AtomicPSLs,
+            // are not held up. A thread that registers after the copy was taken
+            // reads the new snapshot already.
+            std::vector<std::shared_ptr<ReaderRecord>> records;
+            {
+                ReaderRegistry& registry = readerRegistry();
+                std::lock_guard<std::mutex> lock(registry.mutex);
+                records = registry.records;
+            }
+            for (const std::shared_ptr<ReaderRecord>& record : records)
+            {
+                uint64_t epoch = record->epoch.load(std::memory_order_acquire);
+                if ((epoch & 1) == 0)
+                {
+                    continue;
+                }
+                while (record->epoch.load(std::memory_order_acquire) == epoch)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        }
+
+        /**
+         * Map the whole file read-only. The returned pointer unmaps it when released.
+         */
+        std::shared_ptr<const void> mapFile(const std::string& path, size_t& size)
+        {
+#ifdef _WIN32
+            HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ,
+                                      nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL,
+                                      nullptr);
+            if (file == INVALID_HANDLE_VALUE)
+            {
+                throw inaccessible(path);
+            }
+            LARGE_INTEGER length;
+            if (!GetFileSizeEx(file, &length) || length.QuadPart == 0)
+            {
+                CloseHandle(file);
+                throw inaccessible(path);
+            }
+            HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+            CloseHandle(file);
+            if (mapping == nullptr)
+            {
+                throw inaccessible(path);
+            }
+            const void* data = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            CloseHandle(mapping);
+            if (data == nullptr)
+            {
+                throw inaccessible(path);
+            }
+            size = static_cast<size_t>(length.QuadPart);
+            return std::shared_ptr<const void>(
+                data, [](const void* view) { UnmapViewOfFile(view); });
+#else
+            int descriptor = ::open(path.c_str(), O_RDONLY);
+            if (descriptor < 0)
+            {
+                throw inaccessible(path);
+            }
+            struct stat status;
+            if (::fstat(descriptor, &status) != 0 || status.st_size == 0)
+            {
+                ::close(descriptor);
+                throw inaccessible(path);
+            }
+            size_t length = static_cast<size_t>(status.st_size);
+            void* data = ::mmap(nullptr, length, PROT_READ, MAP_SHARED, descriptor, 0);
+            ::close(descriptor);
+            if (data == MAP_FAILED)
+            {
+                throw inaccessible(path);
+            }
+            size = length;
+            return std::shared_ptr<const void>(
+                data, [length](const void* view) {
+                    ::munmap(const_cast<void*>(view), length);
+                });
+#endif
+        }
+    }
+
+    PSL::PSL(std::istream& stream): PSL()
     {
-        levels.reserve(10'000);
+        Builder builder;
+        Section section = Section::Icann;
         std::string line;
         while (std::getline(stream, line))
         {
+            // Section markers are comments, so look for them before trimming
+            if (line.compare(0, 2, "//") == 0)
+            {
+                if (line.find("===BEGIN PRIVATE DOMAINS===") != std::string::npos)
+                {
+                    section = Section::Private;
+                }
+                else if (line.find("===END PRIVATE DOMAINS===") != std::string::npos)
+                {
+                    section = Section::Icann;
+                }
+                continue;
+            }
+
             // Only take up to the first whitespace.
             auto it = std::find_if(line.begin(), line.end(), ::isspace);
             line.resize(it - line.begin());
@@ -24,12 +292,6 @@ namespace Url
                 continue;
             }
 
-            // Skip comments
-            if (line.compare(0, 2, "//") == 0)
-            {
-                continue;
-            }
-
             // We know the line has at least a single character at this point
             if (line[0] == '*')
             {
@@ -39,7 +301,7 @@ namespace Url
                     throw std::invalid_argument("Wildcard rule must be of form *.<host>");
                 }
 
-                add(line, 1, 2);
+                add(builder, line, 1, 2, section);
             }
             else if (line[0] == '!')
             {
@@ -49,13 +311,15 @@ namespace Url
                     throw std::invalid_argument("Exception rule has no hostname.");
                 }
 
-                add(line, -1, 1);
+                add(builder, line, -1, 1, section);
             }
             else
             {
-                add(line, 0, 0);
+                add(builder, line, 0, 0, section);
             }
         }
+
+        compile(builder);
     }
 
     PSL PSL::fromPath(const std::string& path)
@@ -63,9 +327,7 @@ namespace Url
         std::ifstream stream(path);
         if (!stream.good())
         {
-            std::stringstream message;
-            message << "Path '" << path << "' is inaccessible.";
-            throw std::invalid_argument(message.str());
+            throw inaccessible(path);
         }
         return PSL(stream);
     }
@@ -76,57 +338,367 @@ namespace Url
         return PSL(stream);
     }
 
-    std::string PSL::getTLD(const std::string& hostname) const
+    PSL PSL::builtin() noexcept
     {
-        return getLastSegments(hostname, getTLDLength(hostname));
+        return PSL(builtin_table, nullptr);
     }
 
-    std::string PSL::getPLD(const std::string& hostname) const
+    void PSL::saveBinary(const std::string& path) const
     {
-        return getLastSegments(hostname, getTLDLength(hostname) + 1);
+        std::ofstream stream(path, std::ios::binary | std::ios::trunc);
+        if (!stream.good())
+        {
+            throw inaccessible(path);
+        }
+
+        // An empty PSL is saved with just its root so that it maps back to a table
+        const Node root = {0, 1, 0, 0, no_rule, no_rule};
+        const Node* nodes = table.node_count ? table.nodes : &root;
+        size_t node_count = table.node_count ? table.node_count : 1;
+
+        BinaryHeader header;
+        std::memcpy(header.magic, binary_magic, sizeof(header.magic));
+        header.byte_order = binary_byte_order;
+        header.node_size = sizeof(Node);
+        header.node_count = node_count;
+        header.label_size = table.label_size;
+        header.rules = table.rules;
+
+        stream.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        stream.write(reinterpret_cast<const char*>(nodes), node_count * sizeof(Node));
+        stream.write(table.labels, table.label_size);
+        if (!stream.good())
+        {
+            throw inaccessible(path);
+        }
+    }
+
+    PSL PSL::mapBinary(const std::string& path)
+    {
+        size_t size = 0;
+        std::shared_ptr<const void> mapping = mapFile(path, size);
+        const char* data = static_cast<const char*>(mapping.get());
+
+        BinaryHeader header;
+        if (size < sizeof(header))
+        {
+            throw std::invalid_argument("Truncated PSL snapshot: " + path);
+        }
+        std::memcpy(&header, data, sizeof(header));
+        if (std::memcmp(header.magic, binary_magic, sizeof(header.magic)) != 0
+            || header.byte_order != binary_byte_order
+            || header.node_size != sizeof(Node))
+        {
+            throw std::invalid_argument("Not a compatible PSL snapshot: " + path);
+        }
+
+        size_t available = size - sizeof(header);
+        if (header.node_count == 0
+            || header.node_count > available / sizeof(Node)
+            || header.label_size > available - header.node_count * sizeof(Node))
+        {
+            throw std::invalid_argument("Truncated PSL snapshot: " + path);
+        }
+
+        Table mapped{
+            reinterpret_cast<const Node*>(data + sizeof(header)),
+            static_cast<size_t>(header.node_count),
+            data + sizeof(header) + header.node_count * sizeof(Node),
+            static_cast<size_t>(header.label_size),
+            static_cast<size_t>(header.rules)};
+
+        // Lookups trust the offsets, so reject any that point outside the snapshot
+        for (size_t index = 0; index < mapped.node_count; ++index)
+        {
+            const Node& node = mapped.nodes[index];
+            if (node.children > mapped.node_count
+                || node.child_count > mapped.node_count - node.children
+                || node.label > mapped.label_size
+                || node.label_length > mapped.label_size - node.label)
+            {
+                throw std::invalid_argument("Corrupt PSL snapshot: " + path);
+            }
+        }
+
+        return PSL(mapped, std::move(mapping));
+    }
+
+    std::string PSL::getTLD(const std::string& hostname, Section sections) const
+    {
+        return getLastSegments(hostname, getTLDLength(hostname, sections));
+    }
+
+    std::string PSL::getPLD(const std::string& hostname, Section sections) const
+    {
+        return getLastSegments(hostname, getTLDLength(hostname, sections) + 1);
     }
 
     std::pair<std::string, std::string> PSL::getBoth(const std::string& hostname) const
+    {
+        std::pair<size_t, size_t> offsets = getBothOffsets(hostname);
+        return std::make_pair(
+            getSegmentsFrom(hostname, offsets.first),
+            getSegmentsFrom(hostname, offsets.second));
+    }
+
+    PSL::BySection<std::pair<std::string, std::string>> PSL::getBoth(
+        const std::string& hostname, Section sections) const
+    {
+        BySection<std::pair<size_t, size_t>> offsets = getBothOffsets(hostname, sections);
+        return BySection<std::pair<std::string, std::string>>{
+            std::make_pair(
+                getSegmentsFrom(hostname, offsets.icann.first),
+                getSegmentsFrom(hostname, offsets.icann.second)),
+            std::make_pair(
+                getSegmentsFrom(hostname, offsets.all.first),
+                getSegmentsFrom(hostname, offsets.all.second))};
+    }
+
+    size_t PSL::suffixOffset(std::string_view hostname, Section sections) const noexcept
+    {
+        return getLastSegmentsOffset(hostname, getTLDLength(hostname, sections));
+    }
+
+    size_t PSL::registrableOffset(std::string_view hostname, Section sections) const noexcept
+    {
+        return getLastSegmentsOffset(hostname, getTLDLength(hostname, sections) + 1);
+    }
+
+    std::pair<size_t, size_t> PSL::getBothOffsets(std::string_view hostname) const noexcept
     {
         size_t length = getTLDLength(hostname);
         return std::make_pair(
-            getLastSegments(hostname, length),
-            getLastSegments(hostname, length + 1));
+            getLastSegmentsOffset(hostname, length),
+            getLastSegmentsOffset(hostname, length + 1));
+    }
+
+    PSL::BySection<std::pair<size_t, size_t>> PSL::getBothOffsets(
+        std::string_view hostname, Section sections) const noexcept
+    {
+        BySection<std::pair<size_t, size_t>> offsets{
+            std::make_pair(npos, npos), std::make_pair(npos, npos)};
+        BySection<size_t> lengths = getTLDLengths(hostname);
+        if (sections & Section::Icann)
+        {
+            offsets.icann = std::make_pair(
+                getLastSegmentsOffset(hostname, lengths.icann),
+                getLastSegmentsOffset(hostname, lengths.icann + 1));
+        }
+        if (sections & Section::Private)
+        {
+            offsets.all = std::make_pair(
+                getLastSegmentsOffset(hostname, lengths.all),
+                getLastSegmentsOffset(hostname, lengths.all + 1));
+        }
+        return offsets;
     }
 
-    size_t PSL::getTLDLength(const std::string& hostname) const
+    size_t PSL::getTLDLength(std::string_view hostname, Section sections) const noexcept
     {
-        // Reversed copy of hostname
-        std::string tld(hostname.rbegin(), hostname.rend());
-        std::transform(tld.begin(), tld.end(), tld.begin(), ::tolower);
+        BySection<size_t> lengths = getTLDLengths(hostname);
+        return (sections & Section::Private) ? lengths.all : lengths.icann;
+    }
+
+    struct PSL::Cursor
+    {
+        std::string_view hostname;
+        const Node* node;
+        // End of the label to match next
+        size_t end;
+        bool ascii;
+        bool done;
+        BySection<size_t> lengths;
+    };
+
+    void PSL::start(Cursor& cursor, std::string_view hostname) const noexcept
+    {
+        cursor.hostname = hostname;
+        cursor.node = table.nodes;
+        cursor.end = hostname.size();
+        cursor.ascii = Punycode::isAscii(hostname);
+        cursor.done = (table.node_count == 0);
+        cursor.lengths = BySection<size_t>{1, 1};
+    }
 
-        while (tld.size())
+    void PSL::advance(Cursor& cursor) const noexcept
+    {
+        // Walk the trie from the last label of the hostname, remembering the level
+        // of the deepest rule of each section that matched. A private rule wins
+        // over an ICANN rule ending at the same node, as it comes later in the list.
+        const char* data = cursor.hostname.data();
+        size_t start = cursor.end;
+        while (start > 0 && data[start - 1] != '.')
         {
-            auto it = levels.find(tld);
-            if (it != levels.end())
+            --start;
+        }
+
+        // Non-ASCII labels are matched in their punycoded form, so hosts may
+        // mix both forms. Labels that cannot be encoded are matched as they are.
+        const char* label = data + start;
+        size_t length = cursor.end - start;
+        char ace[max_label];
+        if (!cursor.ascii && !Punycode::isAscii(std::string_view(label, length)))
+        {
+            size_t ace_length = Punycode::encodeLabel(
+                std::string_view(label, length), ace, sizeof(ace));
+            if (ace_length > 0)
             {
-                return it->second;
+                label = ace;
+                length = ace_length;
             }
+        }
 
-            size_t position = tld.rfind('.');
-            if (position == std::string::npos || position == 0)
+        const Node* node = findChild(*cursor.node, label, length);
+        if (node == nullptr)
+        {
+            cursor.done = true;
+            return;
+        }
+
+        if (node->icann_level != no_rule)
+        {
+            cursor.lengths.icann = node->icann_level;
+            cursor.lengths.all = node->icann_level;
+        }
+        if (node->private_level != no_rule)
+        {
+            cursor.lengths.all = node->private_level;
+        }
+
+        cursor.node = node;
+        cursor.done = (start == 0);
+        cursor.end = start - 1;
+    }
+
+    PSL::BySection<size_t> PSL::getTLDLengths(std::string_view hostname) const noexcept
+    {
+        Cursor cursor;
+        start(cursor, hostname);
+        while (!cursor.done)
+        {
+            advance(cursor);
+        }
+        return cursor.lengths;
+    }
+
+    void PSL::getBothBatch(const std::string_view* hostnames, size_t count,
+                           std::pair<size_t, size_t>* out) const noexcept
+    {
+        // Tables this small stay in cache, where interleaving only adds overhead.
+        // Just fetch the hostnames ahead of their lookups.
+        constexpr size_t resident_table = 1 << 20;
+        if (table.node_count * sizeof(Node) + table.label_size <= resident_table)
+        {
+            constexpr size_t distance = 8;
+            for (size_t index = 0; index < count; ++index)
             {
-                tld.resize(0);
+                if (index + distance < count && !hostnames[index + distance].empty())
+                {
+                    const std::string_view& ahead = hostnames[index + distance];
+                    prefetch(ahead.data() + ahead.size() - 1);
+                }
+                out[index] = getBothOffsets(hostnames[index]);
             }
-            else
+            return;
+        }
+
+        // Otherwise a lookup mostly waits on the cache misses of its binary searches.
+        // Walking a group of hosts in lockstep lets the children of one host's next
+        // node load while the others take their step.
+        constexpr size_t group = 16;
+        Cursor cursors[group];
+        for (size_t first = 0; first < count; first += group)
+        {
+            size_t size = std::min(group, count - first);
+            for (size_t index = 0; index < size; ++index)
+            {
+                start(cursors[index], hostnames[first + index]);
+            }
+
+            // Lookups read hostnames from their end; fetch those of the next group
+            size_t next = std::min(first + 2 * group, count);
+            for (size_t index = first + group; index < next; ++index)
+            {
+                if (!hostnames[index].empty())
+                {
+                    prefetch(hostnames[index].data() + hostnames[index].size() - 1);
+                }
+            }
+
+            size_t active = size;
+            while (active > 0)
             {
-                tld.resize(position);
+                active = 0;
+                for (size_t index = 0; index < size; ++index)
+                {
+                    Cursor& cursor = cursors[index];
+                    if (cursor.done)
+                    {
+                        continue;
+                    }
+                    advance(cursor);
+                    if (!cursor.done)
+                    {
+                        // The next step binary searches these children; fetch the
+                        // nodes of its first two probes
+                        const Node* children = table.nodes + cursor.node->children;
+                        size_t children_count = cursor.node->child_count;
+                        prefetch(children + children_count / 2);
+                        prefetch(children + children_count / 4);
+                        prefetch(children + 3 * children_count / 4);
+                        ++active;
+                    }
+                }
+            }
+
+            for (size_t index = 0; index < size; ++index)
+            {
+                const Cursor& cursor = cursors[index];
+                out[first + index] = std::make_pair(
+                    getLastSegmentsOffset(cursor.hostname, cursor.lengths.all),
+                    getLastSegmentsOffset(cursor.hostname, cursor.lengths.all + 1));
             }
         }
+    }
 
-        return 1;
+    const PSL::Node* PSL::findChild(
+        const Node& node, const char* label, size_t length) const noexcept
+    {
+        const Node* first = table.nodes + node.children;
+        size_t count = node.child_count;
+        while (count > 0)
+        {
+            size_t half = count / 2;
+            const Node* middle = first + half;
+            int order = compareLabel(
+                table.labels + middle->label, middle->label_length, label, length);
+            if (order == 0)
+            {
+                return middle;
+            }
+            else if (order < 0)
+            {
+                first = middle + 1;
+                count -= half + 1;
+            }
+            else
+            {
+                count = half;
+            }
+        }
+        return nullptr;
     }
 
-    std::string PSL::getLastSegments(const std::string& hostname, size_t segments) const
+    size_t PSL::getLastSegmentsOffset(std::string_view hostname, size_t segments) noexcept
     {
+        if (segments == 0)
+        {
+            return hostname.size();
+        }
+
         size_t position = hostname.size();
         size_t remaining = segments;
-        while (remaining != 0 && position && position != std::string::npos)
+        while (remaining != 0 && position && position != std::string_view::npos)
         {
             position = hostname.rfind('.', position - 1);
             remaining -= 1;
@@ -134,14 +706,27 @@ namespace Url
 
         if (remaining >= 1)
         {
-            return not_found;
+            return npos;
         }
 
-        // Return the whole string if position == std:string::npos
-        size_t start = (position == std::string::npos) ? 0 : position + 1;
+        // The whole string if position == npos
+        return (position == std::string_view::npos) ? 0 : position + 1;
+    }
+
+    std::string PSL::getLastSegments(const std::string& hostname, size_t segments) const
+    {
+        return getSegmentsFrom(hostname, getLastSegmentsOffset(hostname, segments));
+    }
+
+    std::string PSL::getSegmentsFrom(const std::string& hostname, size_t offset) const
+    {
+        if (offset == npos)
+        {
+            return not_found;
+        }
 
-        std::string result(hostname, start);
-        std::transform(result.begin(), result.end(), result.begin(), ::tolower);
+        std::string result(hostname, offset);
+        std::transform(result.begin(), result.end(), result.begin(), lower);
 
         // Leading .'s indicate that the query had an empty segment
         if (result.size() && result[0] == '.')
@@ -166,16 +751,158 @@ namespace Url
         return count;
     }
 
-    void PSL::add(std::string& rule, int level_adjust, size_t trim)
+    void PSL::add(Builder& builder, const std::string& rule, int level_adjust, size_t trim,
+                  Section section)
     {
-        // First unpunycoded
-        std::string copy(rule.rbegin(), rule.rend() - trim);
-        size_t length = countSegments(copy) + level_adjust;
-        levels[copy] = length;
+        std::string host(rule, trim);
+        int length = static_cast<int>(countSegments(host)) + level_adjust;
+        if (length < 0 || length >= no_rule)
+        {
+            throw std::invalid_argument("Rule has too many segments: " + rule);
+        }
+
+        // Insert the labels from the last one, so that the trie can be walked from the
+        // end of a hostname.
+        size_t node = 0;
+        size_t end = host.size();
+        while (true)
+        {
+            size_t start = end;
+            while (start > 0 && host[start - 1] != '.')
+            {
+                --start;
+            }
+
+            // Internationalized labels are stored punycoded, as hostnames are
+            // looked up that way
+            std::string label(host, start, end - start);
+            char ace[max_label];
+            size_t ace_length = Punycode::isAscii(label)
+                ? 0
+                : Punycode::encodeLabel(label, ace, sizeof(ace));
+            if (ace_length > 0)
+            {
+                label.assign(ace, ace_length);
+            }
+            std::transform(label.begin(), label.end(), label.begin(), lower);
+            auto inserted = builder.tree[node].children.emplace(
+                label, builder.tree.size());
+            if (inserted.second)
+            {
+                builder.tree.emplace_back();
+            }
+            node = inserted.first->second;
+
+            if (start == 0)
+            {
+                break;
+            }
+            end = start - 1;
+        }
+
+        uint8_t& level = (section == Section::Private)
+            ? builder.tree[node].private_level
+            : builder.tree[node].icann_level;
+        if (level == no_rule)
+        {
+            builder.rules += 1;
+        }
+        level = static_cast<uint8_t>(length);
+    }
 
-        // And now punycoded
-        copy.assign(rule.rbegin(), rule.rend() - trim);
-        levels[copy] = length;
+    void PSL::compile(const Builder& builder)
+    {
+        auto compiled = std::make_shared<Storage>();
+        std::vector<Node>& nodes = compiled->nodes;
+        std::string& labels = compiled->labels;
+        nodes.assign(1, Node{0, 0, 0, 0, no_rule, no_rule});
+
+        // Lay the nodes out breadth-first so that the children of each node are
+        // contiguous. `order` maps each entry of `nodes` back to the builder.
+        std::vector<size_t> order(1, 0);
+        for (size_t index = 0; index < order.size(); ++index)
+        {
+            const Builder::Pending& pending = builder.tree[order[index]];
+            if (pending.children.size() > std::numeric_limits<uint16_t>::max())
+            {
+                throw std::invalid_argument("Too many rules below a single label.");
+            }
+
+            nodes[index].children = static_cast<uint32_t>(nodes.size());
+            nodes[index].child_count = static_cast<uint16_t>(pending.children.size());
+            for (const auto& child : pending.children)
+            {
+                if (child.first.size() > max_label)
+                {
+                    throw std::invalid_argument("Label too long: " + child.first);
+                }
+
+                nodes.push_back(Node{
+                    static_cast<uint32_t>(labels.size()),
+                    0,
+                    0,
+                    static_cast<uint8_t>(child.first.size()),
+                    builder.tree[child.second].icann_level,
+                    builder.tree[child.second].private_level});
+                labels.append(child.first);
+                order.push_back(child.second);
+            }
+        }
+
+        table = Table{
+            nodes.data(), nodes.size(), labels.data(), labels.size(), builder.rules};
+        storage = std::move(compiled);
+    }
+
+    AtomicPSL::Reader::Reader(const AtomicPSL& owner) noexcept
+    {
+        ReaderRecord& record = threadRecord();
+        if (record.depth++ == 0)
+        {
+            record.epoch.store(
+                record.epoch.load(std::memory_order_relaxed) + 1,
+                std::memory_order_relaxed);
+            // Pairs with the fence in store(): either the writer sees this thread
+            // reading, or this thread sees the new snapshot.
+            std::atomic_thread_fence(std::memory_order_seq_cst);
+        }
+        psl = owner.current.load(std::memory_order_acquire);
+    }
+
+    AtomicPSL::Reader::~Reader()
+    {
+        ReaderRecord& record = threadRecord();
+        if (--record.depth == 0)
+        {
+            record.epoch.store(
+                record.epoch.load(std::memory_order_relaxed) + 1,
+                std::memory_order_release);
+        }
+    }
+
+    AtomicPSL::AtomicPSL(PSL initial)
+        : initial(std::move(initial)), current(&this->initial) { }
+
+    AtomicPSL::~AtomicPSL()
+    {
+        const PSL* psl = current.load(std::memory_order_acquire);
+        if (psl != &initial)
+        {
+            delete psl;
+        }
+    }
+
+    void AtomicPSL::store(PSL psl)
+    {
+        const PSL* replacement = new PSL(std::move(psl));
+        std::lock_guard<std::mutex> lock(writer);
+        const PSL* previous = current.exchange(replacement, std::memory_order_acq_rel);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        waitForReaders();
+        if (previous != &initial)
+        {
+            delete previous;
+        }
     }
 
 };
@@ -1,11 +1,16 @@
 #ifndef PSL_CPP_H
 #define PSL_CPP_H
 
+#include <atomic>
+#include <cstdint>
 #include <istream>
+#include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
 #include <utility>
+#include <vector>
 
 
 namespace Url
@@ -21,20 +26,81 @@ namespace Url
          */
         static const std::string not_found;
 
+        /**
+         * A node of the reversed-label trie. The children of a node are stored
+         * contiguously and sorted by label, so that a lookup can binary search them.
+         */
+        struct Node
+        {
+            // Offset of this node's label in the label pool
+            uint32_t label;
+            // Index of the first child
+            uint32_t children;
+            uint16_t child_count;
+            uint8_t label_length;
+            // Number of segments in the TLD if an ICANN / private rule ends here,
+            // `no_rule` otherwise
+            uint8_t icann_level;
+            uint8_t private_level;
+        };
+
+        static constexpr uint8_t no_rule = 0xFF;
+
+        /**
+         * The sections of the list a rule can come from.
+         *
+         * Rules outside the ===BEGIN/END PRIVATE DOMAINS=== markers are ICANN rules.
+         * Private rules extend the ICANN ones, so a query for Section::Private applies
+         * the rules of both sections.
+         */
+        enum class Section : uint8_t
+        {
+            Icann = 1,
+            Private = 2,
+            All = Icann | Private
+        };
+
+        /**
+         * An answer for each section of the list.
+         */
+        template <typename T>
+        struct BySection
+        {
+            // Using ICANN rules only
+            T icann;
+            // Using ICANN and private rules
+            T all;
+        };
+
+        /**
+         * A compiled trie. The memory it points to is not owned by the table.
+         */
+        struct Table
+        {
+            // Nodes of the trie; nodes[0] is the root and carries no label
+            const Node* nodes;
+            size_t node_count;
+            // All labels of the trie, lowercased and concatenated
+            const char* labels;
+            size_t label_size;
+            // Number of rules in the trie
+            size_t rules;
+        };
+
         /**
          * Read a PSL from an istream.
          */
         PSL(std::istream& stream);
 
-        PSL(): levels() { };
+        PSL(): table{nullptr, 0, nullptr, 0, 0}, storage() { };
 
-        PSL(const PSL& other): levels(other.levels) { }
+        PSL(const PSL& other) = default;
 
-        PSL& operator=(const PSL& other)
-        {
-            levels = other.levels;
-            return *this;
-        }
+        PSL(PSL&& other) = default;
+
+        PSL& operator=(const PSL& other) = default;
+
+        PSL& operator=(PSL&& other) = default;
 
         /**
          * Read the provided path holding a set of PSL rules.
@@ -46,59 +112,246 @@ namespace Url
          */
         static PSL fromString(const std::string& str);
 
+        /**
+         * The PSL compiled into the library at build time. Needs no parsing and no
+         * allocation.
+         */
+        static PSL builtin() noexcept;
+
+        /**
+         * Write the compiled trie to `path` as a binary snapshot that mapBinary can
+         * map and query in place.
+         *
+         * The snapshot holds offsets only and is only readable on machines with the
+         * same endianness.
+         */
+        void saveBinary(const std::string& path) const;
+
+        /**
+         * Map a snapshot written by saveBinary read-only and query it in place.
+         *
+         * The mapping is shared between copies of the returned PSL and released with
+         * the last of them. Processes mapping the same file share its pages.
+         */
+        static PSL mapBinary(const std::string& path);
+
         /**
          * Get just the TLD of the hostname.
          *
-         * Works if the hostname is _either_ punycoded or unpunycoded, but not mixed. If
-         * some segments have been appropriately punycoded and others not, it may return
-         * a wrong answer. If a punycoded host is provided, a punycoded response is
-         * returned. If an unpunycoded host is provided, an unpunycoded response is
-         * returned.
+         * Works if the hostname is punycoded, unpunycoded (UTF-8) or a mix of both, as
+         * non-ASCII labels are punycoded before matching. The response keeps the form
+         * of the hostname it was taken from.
          */
-        std::string getTLD(const std::string& hostname) const;
+        std::string getTLD(
+            const std::string& hostname, Section sections = Section::All) const;
 
         /**
          * Get just the PLD of the hostname.
          *
-         * Works if the hostname is _either_ punycoded or unpunycoded, but not mixed. If
-         * some segments have been appropriately punycoded and others not, it may return
-         * a wrong answer. If a punycoded host is provided, a punycoded response is
-         * returned. If an unpunycoded host is provided, an unpunycoded response is
-         * returned.
+         * Works if the hostname is punycoded, unpunycoded (UTF-8) or a mix of both, as
+         * non-ASCII labels are punycoded before matching. The response keeps the form
+         * of the hostname it was taken from.
          */
-        std::string getPLD(const std::string& hostname) const;
+        std::string getPLD(
+            const std::string& hostname, Section sections = Section::All) const;
 
         /**
          * Get the (TLD, PLD) of the hostname.
          *
-         * Works if the hostname is _either_ punycoded or unpunycoded, but not mixed. If
-         * some segments have been appropriately punycoded and others not, it may return
-         * a wrong answer. If a punycoded host is provided, a punycoded response is
-         * returned. If an unpunycoded host is provided, an unpunycoded response is
-         * returned.
+         * Works if the hostname is punycoded, unpunycoded (UTF-8) or a mix of both, as
+         * non-ASCII labels are punycoded before matching. The response keeps the form
+         * of the hostname it was taken from.
          */
         std::pair<std::string, std::string> getBoth(const std::string& hostname) const;
 
-        size_t numLevels() const noexcept{return levels.size(); }
+        /**
+         * Get the (TLD, PLD) of the hostname for each of the requested sections, with
+         * a single lookup. Answers for sections that were not requested are not_found.
+         */
+        BySection<std::pair<std::string, std::string>> getBoth(
+            const std::string& hostname, Section sections) const;
+
+        /**
+         * Returned by the offset queries when the hostname has too few segments.
+         */
+        static constexpr size_t npos = std::string_view::npos;
+
+        /**
+         * Get the offset at which the TLD of the hostname starts, or npos.
+         *
+         * Nothing is copied, lowercased or allocated: labels are matched against the
+         * rules case-insensitively in place, and the TLD is `hostname.substr(offset)`
+         * in the caller's own case. An offset landing on a '.' means the hostname has
+         * an empty segment there, which getTLD reports by throwing.
+         */
+        size_t suffixOffset(
+            std::string_view hostname, Section sections = Section::All) const noexcept;
+
+        /**
+         * Get the offset at which the PLD of the hostname starts, or npos.
+         *
+         * See suffixOffset.
+         */
+        size_t registrableOffset(
+            std::string_view hostname, Section sections = Section::All) const noexcept;
+
+        /**
+         * Get the (suffixOffset, registrableOffset) of the hostname with one lookup.
+         */
+        std::pair<size_t, size_t> getBothOffsets(std::string_view hostname) const noexcept;
+
+        /**
+         * Get the (suffixOffset, registrableOffset) of the hostname for each of the
+         * requested sections, with one lookup. Sections not requested get npos.
+         */
+        BySection<std::pair<size_t, size_t>> getBothOffsets(
+            std::string_view hostname, Section sections) const noexcept;
+
+        /**
+         * getBothOffsets for `count` hostnames at once, written to `out`.
+         *
+         * The lookups are interleaved and prefetch the trie nodes they visit next,
+         * so that the cache misses of several hostnames overlap. Prefer it to a loop
+         * over getBothOffsets when many hostnames are at hand.
+         */
+        void getBothBatch(const std::string_view* hostnames, size_t count,
+                          std::pair<size_t, size_t>* out) const noexcept;
+
+        void getBothBatch(const std::vector<std::string_view>& hostnames,
+                          std::vector<std::pair<size_t, size_t>>& out) const
+        {
+            out.resize(hostnames.size());
+            getBothBatch(hostnames.data(), hostnames.size(), out.data());
+        }
+
+        size_t numLevels() const noexcept{return table.rules; }
 
     protected:
-        // Mapping of a string rule to its level
-        std::unordered_map<std::string, size_t> levels;
+        PSL(const Table& table, std::shared_ptr<const void> storage)
+            : table(table), storage(std::move(storage)) { }
+
+        // Generated from the public suffix list by cmake/compile_psl.py
+        static const Table builtin_table;
+
+        // Trie of the rules, walked from the last label of a hostname
+        Table table;
+
+        // Keeps the memory behind `table` alive; empty for static tables. It is
+        // never modified, so copies of a PSL share it.
+        std::shared_ptr<const void> storage;
+
+        // Return the child of `node` whose label matches `label` case-insensitively
+        const Node* findChild(
+            const Node& node, const char* label, size_t length) const noexcept;
 
         // Return the number of segments in a hostname
         size_t countSegments(const std::string& hostname) const;
 
         // Return the number of segments in the TLD of the provided hostname
-        size_t getTLDLength(const std::string& hostname) const;
+        size_t getTLDLength(
+            std::string_view hostname, Section sections = Section::All) const noexcept;
+
+        // Return the TLD lengths of the provided hostname for both sections
+        BySection<size_t> getTLDLengths(std::string_view hostname) const noexcept;
+
+        // State of a lookup that can be advanced one label at a time
+        struct Cursor;
+
+        // Prepare `cursor` to look up `hostname`
+        void start(Cursor& cursor, std::string_view hostname) const noexcept;
+
+        // Match the next label of the cursor's hostname
+        void advance(Cursor& cursor) const noexcept;
+
+        // Return the offset of the last `segments` segments of a hostname, or npos
+        static size_t getLastSegmentsOffset(
+            std::string_view hostname, size_t segments) noexcept;
 
         // Return the last `segments` segments of a hostname
         std::string getLastSegments(const std::string& hostname, size_t segments) const;
 
+        // Return the lowercased hostname from `offset`, as getLastSegments does
+        std::string getSegmentsFrom(const std::string& hostname, size_t offset) const;
+
+        // Rules read so far, before they are compiled into the trie
+        struct Builder;
+
         /**
          * Add the provided host with the provided priority, trimming characters off
          * the front, and adjusting the level by the provided number.
          */
-        void add(std::string& host, int level_adjust, size_t trim);
+        void add(Builder& builder, const std::string& rule, int level_adjust, size_t trim,
+                 Section section);
+
+        /**
+         * Flatten the rules collected in `builder` into `table`.
+         */
+        void compile(const Builder& builder);
+    };
+
+    constexpr PSL::Section operator|(PSL::Section left, PSL::Section right)
+    {
+        return static_cast<PSL::Section>(
+            static_cast<uint8_t>(left) | static_cast<uint8_t>(right));
+    }
+
+    constexpr bool operator&(PSL::Section left, PSL::Section right)
+    {
+        return (static_cast<uint8_t>(left) & static_cast<uint8_t>(right)) != 0;
+    }
+
+    /**
+     * Holds the current PSL and lets it be replaced while other threads query it.
+     *
+     * Every PSL published here is treated as an immutable snapshot. Readers only
+     * mark their own thread as reading and load the current snapshot, so they take
+     * no locks and touch no shared reference count. A writer swaps in the new
+     * snapshot atomically and frees the old one once every thread that could have
+     * loaded it has finished reading.
+     */
+    class AtomicPSL
+    {
+    public:
+        /**
+         * Access to the current snapshot, valid for the lifetime of the Reader.
+         *
+         * Readers may nest, but a thread holding a Reader must not call store().
+         */
+        class Reader
+        {
+        public:
+            explicit Reader(const AtomicPSL& owner) noexcept;
+            ~Reader();
+
+            Reader(const Reader&) = delete;
+            Reader& operator=(const Reader&) = delete;
+
+            const PSL& operator*() const noexcept { return *psl; }
+            const PSL* operator->() const noexcept { return psl; }
+
+        private:
+            const PSL* psl;
+        };
+
+        explicit AtomicPSL(PSL initial);
+        ~AtomicPSL();
+
+        AtomicPSL(const AtomicPSL&) = delete;
+        AtomicPSL& operator=(const AtomicPSL&) = delete;
+
+        Reader read() const noexcept { return Reader(*this); }
+
+        /**
+         * Publish `psl` as the current snapshot. Returns once no reader can still
+         * be using the previous one.
+         */
+        void store(PSL psl);
+
+    private:
+        // The first snapshot lives inline so that the default PSL needs no allocation
+        const PSL initial;
+        std::atomic<const PSL*> current;
+        std::mutex writer;
     };
 
 }
@@ -0,0 +1,220 @@
+#include <limits>
+
+#include "punycode.h"
+
+namespace Url
+{
+    namespace Punycode
+    {
+        namespace
+        {
+            // Parameters of RFC 3492, section 5
+            constexpr uint32_t base = 36;
+            constexpr uint32_t tmin = 1;
+            constexpr uint32_t tmax = 26;
+            constexpr uint32_t skew = 38;
+            constexpr uint32_t damp = 700;
+            constexpr uint32_t initial_bias = 72;
+            constexpr uint32_t initial_n = 0x80;
+
+            // A label has at most as many code points as bytes
+            constexpr size_t max_label = 255;
+
+            inline char digit(uint32_t value)
+            {
+                return static_cast<char>(value < 26 ? 'a' + value : '0' + value - 26);
+            }
+
+            uint32_t adapt(uint32_t delta, uint32_t points, bool first)
+            {
+                delta = first ? delta / damp : delta / 2;
+                delta += delta / points;
+                uint32_t k = 0;
+                while (delta > ((base - tmin) * tmax) / 2)
+                {
+                    delta /= base - tmin;
+                    k += base;
+                }
+                return k + (base - tmin + 1) * delta / (delta + skew);
+            }
+
+            /**
+             * Decode UTF-8 into code points, lowercasing ASCII letters. Returns the
+             * number of code points, or 0 on malformed input.
+             */
+            size_t decodeUtf8(std::string_view str, uint32_t* out, size_t capacity)
+            {
+                size_t count = 0;
+                size_t index = 0;
+                while (index < str.size())
+                {
+                    if (count == capacity)
+                    {
+                        return 0;
+                    }
+
+                    unsigned char lead = str[index];
+                    uint32_t point;
+                    size_t extra;
+                    uint32_t minimum;
+                    if (lead < 0x80)
+                    {
+                        out[count++] = (lead >= 'A' && lead <= 'Z') ? lead - 'A' + 'a' : lead;
+                        ++index;
+                        continue;
+                    }
+                    else if ((lead & 0xE0) == 0xC0)
+                    {
+                        point = lead & 0x1F;
+                        extra = 1;
+                        minimum = 0x80;
+                    }
+                    else if ((lead & 0xF0) == 0xE0)
+                    {
+                        point = lead & 0x0F;
+                        extra = 2;
+                        minimum = 0x800;
+                    }
+                    else if ((lead & 0xF8) == 0xF0)
+                    {
+                        point = lead & 0x07;
+                        extra = 3;
+                        minimum = 0x10000;
+                    }
+                    else
+                    {
+                        return 0;
+                    }
+
+                    if (index + extra >= str.size())
+                    {
+                        return 0;
+                    }
+                    for (size_t offset = 1; offset <= extra; ++offset)
+                    {
+                        unsigned char next = str[index + offset];
+                        if ((next & 0xC0) != 0x80)
+                        {
+                            return 0;
+                        }
+                        point = (point << 6) | (next & 0x3F);
+                    }
+
+                    // Reject overlong forms, surrogates and values past Unicode
+                    if (point < minimum || point > 0x10FFFF ||
+                        (point >= 0xD800 && point <= 0xDFFF))
+                    {
+                        return 0;
+                    }
+                    out[count++] = point;
+                    index += extra + 1;
+                }
+                return count;
+            }
+        }
+
+        size_t encodeLabel(std::string_view label, char* out, size_t capacity) noexcept
+        {
+            uint32_t points[max_label];
+            size_t length = decodeUtf8(label, points, max_label);
+            if (length == 0 || capacity < ace_prefix.size())
+            {
+                return 0;
+            }
+
+            size_t written = 0;
+            auto put = [&](char c) {
+                if (written == capacity)
+                {
+                    return false;
+                }
+                out[written++] = c;
+                return true;
+            };
+
+            for (char c : ace_prefix)
+            {
+                put(c);
+            }
+
+            // Copy the basic code points, then the delimiter if there were any
+            uint32_t basic = 0;
+            for (size_t index = 0; index < length; ++index)
+            {
+                if (points[index] < initial_n)
+                {
+                    if (!put(static_cast<char>(points[index])))
+                    {
+                        return 0;
+                    }
+                    ++basic;
+                }
+            }
+            if (basic > 0 && !put('-'))
+            {
+                return 0;
+            }
+
+            uint32_t n = initial_n;
+            uint32_t delta = 0;
+            uint32_t bias = initial_bias;
+            uint32_t handled = basic;
+            const uint32_t limit = std::numeric_limits<uint32_t>::max();
+            while (handled < length)
+            {
+                // The smallest code point not handled yet
+                uint32_t next = limit;
+                for (size_t index = 0; index < length; ++index)
+                {
+                    if (points[index] >= n && points[index] < next)
+                    {
+                        next = points[index];
+                    }
+                }
+
+                if (next - n > (limit - delta) / (handled + 1))
+                {
+                    return 0;
+                }
+                delta += (next - n) * (handled + 1);
+                n = next;
+
+                for (size_t index = 0; index < length; ++index)
+                {
+                    if (points[index] < n && ++delta == 0)
+                    {
+                        return 0;
+                    }
+                    if (points[index] == n)
+                    {
+                        uint32_t q = delta;
+                        for (uint32_t k = base; ; k += base)
+                        {
+                            uint32_t t = (k <= bias) ? tmin : (k >= bias + tmax) ? tmax : k - bias;
+                            if (q < t)
+                            {
+                                break;
+                            }
+                            if (!put(digit(t + (q - t) % (base - t))))
+                            {
+                                return 0;
+                            }
+                            q = (q - t) / (base - t);
+                        }
+                        if (!put(digit(q)))
+                        {
+                            return 0;
+                        }
+                        bias = adapt(delta, handled + 1, handled == basic);
+                        delta = 0;
+                        ++handled;
+                    }
+                }
+                ++delta;
+                ++n;
+            }
+
+            return written;
+        }
+    }
+}
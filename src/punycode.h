@@ -0,0 +1,62 @@
+#ifndef PUNYCODE_CPP_H
+#define PUNYCODE_CPP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string_view>
+
+namespace Url
+{
+
+    /**
+     * Punycode (RFC 3492) conversion of hostname labels, as used by IDNA.
+     */
+    namespace Punycode
+    {
+        /**
+         * The ACE prefix marking a punycoded label.
+         */
+        static constexpr std::string_view ace_prefix = "xn--";
+
+        /**
+         * Whether every byte of `str` is below 0x80. Checks a word at a time.
+         */
+        inline bool isAscii(std::string_view str) noexcept
+        {
+            const char* data = str.data();
+            size_t size = str.size();
+            size_t index = 0;
+            for (; index + sizeof(uint64_t) <= size; index += sizeof(uint64_t))
+            {
+                uint64_t word;
+                std::memcpy(&word, data + index, sizeof(word));
+                if (word & 0x8080808080808080ULL)
+                {
+                    return false;
+                }
+            }
+            for (; index < size; ++index)
+            {
+                if (static_cast<unsigned char>(data[index]) >= 0x80)
+                {
+                    return false;
+                }
+            }
+            return true;
+        }
+
+        /**
+         * Write the ACE form ("xn--" followed by the punycode) of a UTF-8 label into
+         * `out`, with ASCII letters lowercased.
+         *
+         * Returns the number of bytes written, or 0 if the label is not valid UTF-8
+         * or its ACE form does not fit into `capacity` bytes. Meant for labels with
+         * non-ASCII bytes; it does not apply the Unicode mappings of UTS #46.
+         */
+        size_t encodeLabel(std::string_view label, char* out, size_t capacity) noexcept;
+    }
+
+}
+
+#endif
@@ -0,0 +1,350 @@
+#include <atomic>
+#include <cstring>
+
+#include "character_class.h"
+#include "scan.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define URL_SCAN_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(__GNUC__) || defined(__clang__)
+#define URL_SCAN_TARGET(name) __attribute__((target(name)))
+#else
+#define URL_SCAN_TARGET(name)
+#endif
+
+namespace Url
+{
+    namespace Scan
+    {
+        namespace
+        {
+            // Classifies block_size bytes at `data`
+            typedef uint32_t (*Block)(const char* data);
+
+            // The vector kernels below compare against these one by one
+            static_assert(Characters::delimiters == ":/?#@;", "Update the kernels");
+
+            uint32_t scalarBlock(const char* data)
+            {
+                uint32_t mask = 0;
+                for (size_t index = 0; index < block_size; ++index)
+                {
+                    mask |= static_cast<uint32_t>(
+                        Characters::is(data[index], Characters::Delimiter)) << index;
+                }
+                return mask;
+            }
+
+#ifdef URL_SCAN_X86
+            URL_SCAN_TARGET("sse4.2")
+            uint32_t sse42Block(const char* data)
+            {
+                const __m128i set = _mm_setr_epi8(
+                    ':', '/', '?', '#', '@', ';', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+                constexpr int mode =
+                    _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_BIT_MASK;
+                __m128i low = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data));
+                __m128i high = _mm_loadu_si128(
+                    reinterpret_cast<const __m128i*>(data + 16));
+                uint32_t low_mask = static_cast<uint32_t>(
+                    _mm_cvtsi128_si32(_mm_cmpestrm(set, 6, low, 16, mode))) & 0xFFFF;
+                uint32_t high_mask = static_cast<uint32_t>(
+                    _mm_cvtsi128_si32(_mm_cmpestrm(set, 6, high, 16, mode))) & 0xFFFF;
+                return low_mask | (high_mask << 16);
+            }
+
+            URL_SCAN_TARGET("avx2")
+            uint32_t avx2Block(const char* data)
+            {
+                __m256i bytes = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data));
+                __m256i found = _mm256_or_si256(
+                    _mm256_or_si256(
+                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(':')),
+                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('/'))),
+                    _mm256_or_si256(
+                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('?')),
+                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('#'))));
+                found = _mm256_or_si256(
+                    found,
+                    _mm256_or_si256(
+                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('@')),
+                        _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(';'))));
+                return static_cast<uint32_t>(_mm256_movemask_epi8(found));
+            }
+
+            /**
+             * Skip the leading members of a class 16 bytes at a time, using the nibble
+             * table of the class. Returns where the scalar code should go on.
+             */
+            URL_SCAN_TARGET("sse4.2")
+            size_t sse42FirstOutside(const char* data, size_t size, const uint8_t* nibbles)
+            {
+                const __m128i rows = _mm_loadu_si128(reinterpret_cast<const __m128i*>(nibbles));
+                // Bytes of 0x80 and above have a high nibble that selects no bit
+                const __m128i bits = _mm_setr_epi8(
+                    1, 2, 4, 8, 16, 32, 64, -128, 0, 0, 0, 0, 0, 0, 0, 0);
+                const __m128i low_nibble = _mm_set1_epi8(0x0F);
+                size_t index = 0;
+                for (; index + 16 <= size; index += 16)
+                {
+                    __m128i bytes = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(data + index));
+                    __m128i row = _mm_shuffle_epi8(rows, _mm_and_si128(bytes, low_nibble));
+                    __m128i bit = _mm_shuffle_epi8(
+                        bits, _mm_and_si128(_mm_srli_epi16(bytes, 4), low_nibble));
+                    uint32_t outside = static_cast<uint32_t>(_mm_movemask_epi8(
+                        _mm_cmpeq_epi8(_mm_and_si128(row, bit), _mm_setzero_si128())));
+                    if (outside)
+                    {
+                        return index + lowestBit(outside);
+                    }
+                }
+                return index;
+            }
+
+            // Shuffles picking byte 3k + offset of a 48-byte block out of each of its
+            // three 16-byte thirds into byte k
+            struct Gather
+            {
+                int8_t masks[3][3][16] = {};
+
+                constexpr Gather()
+                {
+                    for (size_t offset = 0; offset < 3; ++offset)
+                    {
+                        for (size_t third = 0; third < 3; ++third)
+                        {
+                            for (size_t k = 0; k < 16; ++k)
+                            {
+                                size_t position = 3 * k + offset;
+                                masks[offset][third][k] = (position / 16 == third)
+                                    ? static_cast<int8_t>(position % 16) : -128;
+                            }
+                        }
+                    }
+                }
+            };
+
+            constexpr Gather gather_masks;
+
+            URL_SCAN_TARGET("sse4.2")
+            inline __m128i gather(const __m128i* thirds, size_t offset)
+            {
+                __m128i result = _mm_setzero_si128();
+                for (size_t third = 0; third < 3; ++third)
+                {
+                    __m128i mask = _mm_loadu_si128(
+                        reinterpret_cast<const __m128i*>(gather_masks.masks[offset][third]));
+                    result = _mm_or_si128(result, _mm_shuffle_epi8(thirds[third], mask));
+                }
+                return result;
+            }
+
+            // Values of 16 hex digits, with `valid` set to 0xFF where there is one
+            URL_SCAN_TARGET("sse4.2")
+            inline __m128i hexValues(__m128i digits, __m128i& valid)
+            {
+                __m128i lower = _mm_or_si128(digits, _mm_set1_epi8(0x20));
+                __m128i digit = _mm_and_si128(
+                    _mm_cmpgt_epi8(digits, _mm_set1_epi8('0' - 1)),
+                    _mm_cmpgt_epi8(_mm_set1_epi8('9' + 1), digits));
+                __m128i letter = _mm_and_si128(
+                    _mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)),
+                    _mm_cmpgt_epi8(_mm_set1_epi8('f' + 1), lower));
+                valid = _mm_or_si128(digit, letter);
+                return _mm_or_si128(
+                    _mm_and_si128(digit, _mm_sub_epi8(digits, _mm_set1_epi8('0'))),
+                    _mm_and_si128(letter, _mm_sub_epi8(lower, _mm_set1_epi8('a' - 10))));
+            }
+
+            /**
+             * Decode whole blocks of 16 consecutive escapes (48 bytes). Returns the
+             * number of escapes decoded; the scalar code finishes the run.
+             */
+            URL_SCAN_TARGET("sse4.2")
+            size_t sse42DecodeEscapes(const char* data, size_t size, char* out)
+            {
+                size_t decoded = 0;
+                for (; size - 3 * decoded >= 48; decoded += 16)
+                {
+                    const char* block = data + 3 * decoded;
+                    __m128i thirds[3];
+                    for (size_t third = 0; third < 3; ++third)
+                    {
+                        thirds[third] = _mm_loadu_si128(
+                            reinterpret_cast<const __m128i*>(block + 16 * third));
+                    }
+
+                    __m128i high_valid;
+                    __m128i low_valid;
+                    __m128i high = hexValues(gather(thirds, 1), high_valid);
+                    __m128i low = hexValues(gather(thirds, 2), low_valid);
+                    __m128i valid = _mm_and_si128(
+                        _mm_cmpeq_epi8(gather(thirds, 0), _mm_set1_epi8('%')),
+                        _mm_and_si128(high_valid, low_valid));
+                    if (_mm_movemask_epi8(valid) != 0xFFFF)
+                    {
+                        break;
+                    }
+
+                    // Each high digit is below 16, so it does not shift into its
+                    // neighbour
+                    __m128i bytes = _mm_or_si128(_mm_slli_epi16(high, 4), low);
+                    // The block was read in full before this, and `out` trails it
+                    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + decoded), bytes);
+                }
+                return decoded;
+            }
+#endif
+
+            bool supports(Kernel kernel)
+            {
+                switch (kernel)
+                {
+                case Kernel::Scalar:
+                    return true;
+#if defined(URL_SCAN_X86) && (defined(__GNUC__) || defined(__clang__))
+                case Kernel::Sse42:
+                    return __builtin_cpu_supports("sse4.2");
+                case Kernel::Avx2:
+                    return __builtin_cpu_supports("avx2");
+#elif defined(URL_SCAN_X86) && defined(_MSC_VER)
+                case Kernel::Sse42:
+                {
+                    int info[4];
+                    __cpuid(info, 1);
+                    return (info[2] & (1 << 20)) != 0;
+                }
+                case Kernel::Avx2:
+                {
+                    int info[4];
+                    __cpuid(info, 1);
+                    // The OS must save the AVX registers too
+                    bool avx = (info[2] & (1 << 27)) && (info[2] & (1 << 28))
+                        && (_xgetbv(0) & 6) == 6;
+                    __cpuidex(info, 7, 0);
+                    return avx && (info[1] & (1 << 5)) != 0;
+                }
+#endif
+                default:
+                    return false;
+                }
+            }
+
+            Block blockOf(Kernel kernel)
+            {
+                switch (kernel)
+                {
+#ifdef URL_SCAN_X86
+                case Kernel::Sse42:
+                    return sse42Block;
+                case Kernel::Avx2:
+                    return avx2Block;
+#endif
+                default:
+                    return scalarBlock;
+                }
+            }
+
+            uint32_t resolve(const char* data);
+
+            // Starts out resolving the best kernel on first use, which avoids
+            // depending on the order of static initialization
+            std::atomic<Block> current(resolve);
+            std::atomic<Kernel> current_kernel(Kernel::Scalar);
+
+            void select(Kernel kernel)
+            {
+                current_kernel.store(kernel, std::memory_order_relaxed);
+                current.store(blockOf(kernel), std::memory_order_relaxed);
+            }
+
+            uint32_t resolve(const char* data)
+            {
+                Kernel best = supports(Kernel::Avx2) ? Kernel::Avx2
+                    : supports(Kernel::Sse42)        ? Kernel::Sse42
+                                                     : Kernel::Scalar;
+                select(best);
+                return blockOf(best)(data);
+            }
+        }
+
+        Kernel kernel() noexcept
+        {
+            if (current.load(std::memory_order_relaxed) == resolve)
+            {
+                char empty[block_size] = {};
+                resolve(empty);
+            }
+            return current_kernel.load(std::memory_order_relaxed);
+        }
+
+        bool useKernel(Kernel kernel) noexcept
+        {
+            if (!supports(kernel))
+            {
+                return false;
+            }
+            select(kernel);
+            return true;
+        }
+
+        uint32_t delimiters(const char* data, size_t size) noexcept
+        {
+            Block block = current.load(std::memory_order_relaxed);
+            if (size >= block_size)
+            {
+                return block(data);
+            }
+
+            // Never read past the end; NUL bytes are not delimiters
+            char padded[block_size] = {};
+            std::memcpy(padded, data, size);
+            return block(padded);
+        }
+
+        size_t firstOutside(std::string_view text, const CharacterClass& members) noexcept
+        {
+            size_t index = 0;
+#ifdef URL_SCAN_X86
+            if (members.ascii() && kernel() != Kernel::Scalar)
+            {
+                index = sse42FirstOutside(text.data(), text.size(), members.nibbles());
+            }
+#endif
+            while (index < text.size() && members(text[index]))
+            {
+                ++index;
+            }
+            return index;
+        }
+
+        size_t decodeEscapes(const char* data, size_t size, char* out) noexcept
+        {
+            size_t decoded = 0;
+#ifdef URL_SCAN_X86
+            if (size >= 48 && kernel() != Kernel::Scalar)
+            {
+                decoded = sse42DecodeEscapes(data, size, out);
+            }
+#endif
+            for (size_t index = 3 * decoded; index + 2 < size && data[index] == '%'; index += 3)
+            {
+                int high = Characters::hexValue(data[index + 1]);
+                int low = Characters::hexValue(data[index + 2]);
+                if (high < 0 || low < 0)
+                {
+                    break;
+                }
+                out[decoded++] = static_cast<char>(high * 16 + low);
+            }
+            return decoded;
+        }
+    }
+}
@@ -0,0 +1,130 @@
+#ifndef SCAN_CPP_H
+#define SCAN_CPP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+#include "character_class.h"
+
+namespace Url
+{
+
+    /**
+     * Vectorized search for the structural delimiters of a URL: ':', '/', '?', '#',
+     * '@' and ';'.
+     *
+     * The URL is classified a block of 32 bytes at a time into a bitmask of
+     * delimiter positions. The kernel doing so is picked on first use from what the
+     * CPU supports, so that one binary runs everywhere. The same kernel choice
+     * decides how the escaping code searches for bytes to rewrite and decodes
+     * runs of percent escapes.
+     */
+    namespace Scan
+    {
+        enum class Kernel
+        {
+            Scalar,
+            Sse42,
+            Avx2
+        };
+
+        /**
+         * Bytes classified by one call of a kernel.
+         */
+        static constexpr size_t block_size = 32;
+
+        /**
+         * The kernel in use.
+         */
+        Kernel kernel() noexcept;
+
+        /**
+         * Switch to `kernel` if the CPU supports it. Returns whether it did. Not
+         * safe while other threads parse URLs; meant for tests and benchmarks.
+         */
+        bool useKernel(Kernel kernel) noexcept;
+
+        /**
+         * Bitmask of the delimiters among the `size` bytes at `data`, at most
+         * block_size of them: bit i is set if data[i] is a delimiter.
+         */
+        uint32_t delimiters(const char* data, size_t size) noexcept;
+
+        /**
+         * Position of the first byte of `text` that is not in `members`, or its size
+         * if there is none.
+         */
+        size_t firstOutside(std::string_view text, const CharacterClass& members) noexcept;
+
+        /**
+         * Decode the run of "%XX" escapes at the start of the `size` bytes at `data`
+         * into `out`, one byte each, and return how many were decoded. `out` may
+         * point at or before `data`, to decode in place.
+         */
+        size_t decodeEscapes(const char* data, size_t size, char* out) noexcept;
+
+        /**
+         * Index of the lowest set bit of a non-zero mask.
+         */
+        inline unsigned lowestBit(uint32_t mask) noexcept
+        {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned>(__builtin_ctz(mask));
+#else
+            unsigned index = 0;
+            while (!(mask & 1))
+            {
+                mask >>= 1;
+                ++index;
+            }
+            return index;
+#endif
+        }
+
+        /**
+         * Walks the delimiters of a string in order.
+         */
+        class Delimiters
+        {
+        public:
+            Delimiters(std::string_view text, size_t from) noexcept
+                : data(text.data()), size(text.size()), block(from), mask(0)
+            {
+                if (block < size)
+                {
+                    mask = delimiters(data + block, size - block);
+                }
+            }
+
+            /**
+             * Position of the next delimiter, or the size of the string once there
+             * are no more.
+             */
+            size_t next() noexcept
+            {
+                while (mask == 0)
+                {
+                    block += block_size;
+                    if (block >= size)
+                    {
+                        return size;
+                    }
+                    mask = delimiters(data + block, size - block);
+                }
+                size_t position = block + lowestBit(mask);
+                mask &= mask - 1;
+                return position;
+            }
+
+        private:
+            const char* data;
+            size_t size;
+            size_t block;
+            uint32_t mask;
+        };
+    }
+
+}
+
+#endif
@@ -0,0 +1,177 @@
+#ifndef SCHEME_CPP_H
+#define SCHEME_CPP_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+
+namespace Url
+{
+
+    /**
+     * The schemes the parser knows about, and how they behave.
+     *
+     * A scheme is resolved once into a SchemeId through a perfect hash computed at
+     * compile time: one table load and one comparison against the only name that
+     * could match. After that, its properties are bits of a flag word.
+     */
+    enum class SchemeId : uint8_t
+    {
+        // No scheme at all, as in "//example.com/"
+        None,
+        File,
+        Ftp,
+        Git,
+        GitSsh,
+        Gopher,
+        Hdl,
+        Http,
+        Https,
+        Imap,
+        Mms,
+        Nfs,
+        Nntp,
+        Prospero,
+        Rsync,
+        Rtsp,
+        Rtspu,
+        Sftp,
+        Shttp,
+        Sip,
+        Sips,
+        Sms,
+        Snews,
+        Svn,
+        SvnSsh,
+        Tel,
+        Telnet,
+        Wais,
+        // A scheme that is not one of the above
+        Other
+    };
+
+    namespace Schemes
+    {
+        enum Flag : uint8_t
+        {
+            // Resolved relative to a base URL
+            Relative = 1 << 0,
+            // Has a "//" netloc
+            Netloc   = 1 << 1,
+            // Has ";" params in its path
+            Params   = 1 << 2,
+            // Taken as the scheme even when followed by only digits ("http:80")
+            Known    = 1 << 3
+        };
+
+        struct Info
+        {
+            std::string_view name;
+            uint8_t flags;
+            // The port that is implied when none is given, or 0
+            uint16_t default_port;
+        };
+
+        // Indexed by SchemeId
+        static constexpr Info infos[] = {
+            {"",         Relative | Netloc | Params | Known, 0},
+            {"file",     Relative | Netloc          | Known, 0},
+            {"ftp",      Relative | Netloc | Params | Known, 0},
+            {"git",                 Netloc          | Known, 0},
+            {"git+ssh",             Netloc          | Known, 0},
+            {"gopher",   Relative | Netloc          | Known, 0},
+            {"hdl",                          Params | Known, 0},
+            {"http",     Relative | Netloc | Params | Known, 80},
+            {"https",    Relative | Netloc | Params | Known, 443},
+            {"imap",     Relative | Netloc | Params | Known, 0},
+            {"mms",      Relative | Netloc | Params | Known, 0},
+            {"nfs",                 Netloc          | Known, 0},
+            {"nntp",     Relative | Netloc          | Known, 0},
+            {"prospero", Relative | Netloc | Params | Known, 0},
+            {"rsync",               Netloc          | Known, 0},
+            {"rtsp",     Relative | Netloc | Params | Known, 0},
+            {"rtspu",    Relative | Netloc | Params | Known, 0},
+            {"sftp",     Relative | Netloc | Params | Known, 0},
+            {"shttp",    Relative | Netloc | Params | Known, 0},
+            {"sip",                          Params | Known, 0},
+            {"sips",                         Params | Known, 0},
+            {"sms",                                   Known, 0},
+            {"snews",               Netloc          | Known, 0},
+            {"svn",      Relative | Netloc          | Known, 0},
+            {"svn+ssh",  Relative | Netloc          | Known, 0},
+            {"tel",                          Params | Known, 0},
+            {"telnet",              Netloc          | Known, 0},
+            {"wais",     Relative | Netloc          | Known, 0},
+            {"",         0,                                  0}
+        };
+
+        static constexpr size_t count = sizeof(infos) / sizeof(infos[0]);
+        static_assert(count == static_cast<size_t>(SchemeId::Other) + 1,
+                      "Every SchemeId needs an Info");
+
+        // No known name is longer than this
+        static constexpr size_t max_length = 8;
+
+        static constexpr size_t slot_count = 64;
+
+        constexpr size_t slot(std::string_view name) noexcept
+        {
+            return (static_cast<unsigned char>(name.front())
+                + 5 * static_cast<unsigned char>(name.back())
+                + 7 * name.size()) % slot_count;
+        }
+
+        struct Slots
+        {
+            SchemeId ids[slot_count] = {};
+            bool perfect = true;
+
+            constexpr Slots()
+            {
+                for (size_t index = 0; index < slot_count; ++index)
+                {
+                    ids[index] = SchemeId::Other;
+                }
+                for (size_t id = 1; id + 1 < count; ++id)
+                {
+                    size_t at = slot(infos[id].name);
+                    perfect = perfect && ids[at] == SchemeId::Other;
+                    ids[at] = static_cast<SchemeId>(id);
+                }
+            }
+        };
+
+        static constexpr Slots slots;
+        static_assert(slots.perfect, "Pick another slot() for these names");
+
+        /**
+         * The SchemeId of a scheme, which must already be lowercase to be known.
+         */
+        constexpr SchemeId lookup(std::string_view scheme) noexcept
+        {
+            if (scheme.empty())
+            {
+                return SchemeId::None;
+            }
+            if (scheme.size() > max_length)
+            {
+                return SchemeId::Other;
+            }
+            SchemeId id = slots.ids[slot(scheme)];
+            return infos[static_cast<size_t>(id)].name == scheme ? id : SchemeId::Other;
+        }
+
+        constexpr const Info& info(SchemeId id) noexcept
+        {
+            return infos[static_cast<size_t>(id)];
+        }
+
+        constexpr bool has(SchemeId id, Flag flag) noexcept
+        {
+            return (info(id).flags & flag) != 0;
+        }
+    }
+
+}
+
+#endif
@@ -1,300 +1,351 @@
 #include <algorithm>
+#include <cctype>
+#include <charconv>
+#include <limits>
 #include <string>
 #include <iterator>
 #include <unordered_map>
 #include <unordered_set>
 #include <iostream>
 #include <iterator>
-#include <sstream>
 
+#include "hash64.h"
+#include "pieces.h"
+#include "scan.h"
 #include "url.h"
 
 namespace Url
 {
 
-    /* Character classes */
-    const CharacterClass Url::GEN_DELIMS(":/?#[]@");
-    const CharacterClass Url::SUB_DELIMS("!$&'()*+,;=");
-    const CharacterClass Url::DIGIT("0123456789");
-    const CharacterClass Url::ALPHA(
-        "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz");
-    const CharacterClass Url::UNRESERVED(
-        Url::ALPHA.chars() + Url::DIGIT.chars() + "-._~");
-    const CharacterClass Url::RESERVED(
-        Url::GEN_DELIMS.chars() + Url::SUB_DELIMS.chars());
-    const CharacterClass Url::PCHAR(
-        Url::UNRESERVED.chars() + Url::SUB_DELIMS.chars() + ":@");
-    const CharacterClass Url::PATH(
-        Url::PCHAR.chars() + "/");
-    const CharacterClass Url::QUERY(
-        Url::PCHAR.chars() + "/?");
-    const CharacterClass Url::FRAGMENT(
-        Url::PCHAR.chars() + "/?");
-    const CharacterClass Url::USERINFO(
-        Url::UNRESERVED.chars() + Url::SUB_DELIMS.chars() + ":");
-    const CharacterClass Url::HEX("0123456789ABCDEF");
-    const CharacterClass Url::SCHEME(
-        "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789+-.");
-    const std::vector<signed char> Url::HEX_TO_DEC = {
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-         0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
-
-        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-
-        -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
-        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
-    };
-    const std::unordered_map<std::string, int> Url::PORTS = {
-        {"http", 80},
-        {"https", 443}
-    };
-    const std::unordered_set<std::string> Url::USES_RELATIVE = {
-        "",
-        "file",
-        "ftp",
-        "gopher",
-        "http",
-        "https",
-        "imap",
-        "mms",
-        "nntp",
-        "prospero",
-        "rtsp",
-        "rtspu",
-        "sftp",
-        "shttp",
-        "svn",
-        "svn+ssh",
-        "wais"
-    };
-    const std::unordered_set<std::string> Url::USES_NETLOC = {
-        "",
-        "file",
-        "ftp",
-        "git",
-        "git+ssh",
-        "gopher",
-        "http",
-        "https",
-        "imap",
-        "mms",
-        "nfs",
-        "nntp",
-        "prospero",
-        "rsync",
-        "rtsp",
-        "rtspu",
-        "sftp",
-        "shttp",
-        "snews",
-        "svn",
-        "svn+ssh",
-        "telnet",
-        "wais"
-    };
-    const std::unordered_set<std::string> Url::USES_PARAMS = {
-        "",
-        "ftp",
-        "hdl",
-        "http",
-        "https",
-        "imap",
-        "mms",
-        "prospero",
-        "rtsp",
-        "rtspu",
-        "sftp",
-        "shttp",
-        "sip",
-        "sips",
-        "tel"
-    };
-    const std::unordered_set<std::string> Url::KNOWN_PROTOCOLS = {
-        "",
-        "file",
-        "ftp",
-        "git",
-        "git+ssh",
-        "gopher",
-        "hdl",
-        "http",
-        "https",
-        "imap",
-        "mms",
-        "nfs",
-        "nntp",
-        "prospero",
-        "rsync",
-        "rtsp",
-        "rtspu",
-        "sftp",
-        "shttp",
-        "sip",
-        "sips",
-        "sms",
-        "snews",
-        "svn",
-        "svn+ssh",
-        "tel",
-        "telnet",
-        "wais"
-    };
-
-    Url::Url(const std::string& url): port_(0), has_params_(false), has_query_(false)
-    {
-        size_t position = 0;
-        size_t index = url.find(':');
-        if (index != std::string::npos)
-        {
-            // All the characters in our would-be scheme must be in SCHEME
-            if (std::all_of(
-                    url.begin(),
-                    url.begin() + index,
-                    [](char c) { return SCHEME(c); } ))
-            {
-                // If there is nothing after the : or there are any non-digits, this is
-                // the scheme
-                if ((index + 1) >= url.length()
-                    || std::any_of(
-                        url.begin() + index + 1,
-                        url.end(),
-                        [](char c) { return !DIGIT(c); }))
-                {
-                    scheme_.assign(url, 0, index);
-                    std::transform(
-                        scheme_.begin(), scheme_.end(), scheme_.begin(), ::tolower);
-                    position = index + 1;
-                }
-                else
-                {
-                    scheme_.assign(url, 0, index);
-                    std::transform(
-                        scheme_.begin(), scheme_.end(), scheme_.begin(), ::tolower);
-                    if (KNOWN_PROTOCOLS.find(scheme_) != KNOWN_PROTOCOLS.end())
-                    {
-                        position = index + 1;
-                    }
-                    else
-                    {
-                        scheme_.clear();
-                    }
-                }
+    namespace
+    {
+        /**
+         * Parse a port the way std::stoi would, without exceptions: leading white
+         * space, an optional sign, then decimal digits that must reach the end.
+         */
+        ParseError parsePort(std::string_view text, int& port)
+        {
+            size_t index = 0;
+            while (index < text.size() && std::isspace(static_cast<unsigned char>(text[index])))
+            {
+                ++index;
+            }
+            bool negative = false;
+            if (index < text.size() && (text[index] == '+' || text[index] == '-'))
+            {
+                negative = text[index] == '-';
+                ++index;
+            }
+
+            const uint64_t limit = static_cast<uint64_t>(std::numeric_limits<int>::max())
+                + (negative ? 1 : 0);
+            size_t first = index;
+            uint64_t value = 0;
+            for (; index < text.size() && Url::DIGIT(text[index]); ++index)
+            {
+                // Saturate, so that any number of digits cannot wrap around
+                value = std::min(value * 10 + (text[index] - '0'), limit + 1);
+            }
+
+            if (index == first)
+            {
+                return ParseError::PortNotANumber;
+            }
+            else if (value > limit)
+            {
+                return ParseError::PortOutOfRange;
+            }
+            else if (index != text.size())
+            {
+                return ParseError::PortNotANumber;
+            }
+
+            int64_t signed_value = negative
+                ? -static_cast<int64_t>(value) : static_cast<int64_t>(value);
+            if (signed_value > 65535)
+            {
+                return ParseError::PortTooHigh;
+            }
+            else if (signed_value < 0)
+            {
+                return ParseError::PortNegative;
+            }
+            port = static_cast<int>(signed_value);
+            return ParseError::None;
+        }
+    }
+
+    Url::Url(std::string_view url, std::pmr::memory_resource* resource)
+        : buffer_(resource)
+    {
+        std::string_view detail;
+        ParseError error = parse(url, detail);
+        if (error != ParseError::None)
+        {
+            throw UrlParseException(describe(error, detail));
+        }
+    }
+
+    Url::Url(std::string_view url, ParseError& error, std::pmr::memory_resource* resource)
+        : buffer_(resource)
+    {
+        std::string_view detail;
+        error = parse(url, detail);
+    }
+
+    Url::Url(const Url& other, std::pmr::memory_resource* resource)
+        : buffer_(other.buffer_, resource),
+          scheme_(other.scheme_),
+          scheme_id_(other.scheme_id_),
+          host_(other.host_),
+          port_(other.port_),
+          path_(other.path_),
+          params_(other.params_),
+          query_(other.query_),
+          fragment_(other.fragment_),
+          userinfo_(other.userinfo_),
+          has_params_(other.has_params_),
+          has_query_(other.has_query_)
+    {
+    }
+
+    std::string Url::describe(ParseError error, std::string_view detail)
+    {
+        switch (error)
+        {
+        case ParseError::None:
+            return "";
+        case ParseError::TooLong:
+            return "URL too long.";
+        case ParseError::PortNotANumber:
+            return "Port not a number: " + std::string(detail);
+        case ParseError::PortOutOfRange:
+            return "Port out of integer range: " + std::string(detail);
+        case ParseError::PortTooHigh:
+            return "Port too high: " + std::string(detail);
+        case ParseError::PortNegative:
+            return "Port negative: " + std::string(detail);
+        }
+        return "Malformed URL.";
+    }
+
+    ParseError Url::parse(std::string_view url, std::string_view& detail)
+    {
+        if (url.size() > std::numeric_limits<uint32_t>::max())
+        {
+            return ParseError::TooLong;
+        }
+        buffer_.assign(url.data(), url.size());
+
+        // Every component is found with one scan from left to right over the
+        // positions of the delimiters, and recorded as a span of the buffer.
+        const char* data = buffer_.data();
+        const uint32_t length = static_cast<uint32_t>(buffer_.size());
+        uint32_t position = 0;
+        Scan::Delimiters delimiters(buffer_, 0);
+        uint32_t index = static_cast<uint32_t>(delimiters.next());
+
+        // The scheme is a run of scheme characters ended by a ':'
+        if (index < length
+            && data[index] == ':'
+            && std::all_of(data, data + index, [](char c) { return SCHEME(c); }))
+        {
+            // If there is nothing after the : or there are any non-digits, this is
+            // the scheme. Otherwise it may be a host and port, unless the scheme is
+            // a known one.
+            uint32_t digit = index + 1;
+            while (digit < length && DIGIT(data[digit]))
+            {
+                ++digit;
+            }
+            bool is_scheme = (index + 1) >= length || digit < length;
+            if (!is_scheme && index <= Schemes::max_length)
+            {
+                char scheme[Schemes::max_length];
+                std::transform(data, data + index, scheme, ::tolower);
+                is_scheme = Schemes::has(
+                    Schemes::lookup(std::string_view(scheme, index)), Schemes::Known);
+            }
+
+            if (is_scheme)
+            {
+                std::transform(
+                    buffer_.begin(), buffer_.begin() + index, buffer_.begin(), ::tolower);
+                scheme_ = Span{0, index};
+                scheme_id_ = Schemes::lookup(scheme());
+                position = index + 1;
+                index = static_cast<uint32_t>(delimiters.next());
             }
         }
 
         // Search for the netloc
-        if ((url.length() - position) >= 1
-            && url[position] == '/'
-            && url[position + 1] == '/')
+        bool has_path = true;
+        if ((length - position) >= 2
+            && data[position] == '/'
+            && data[position + 1] == '/')
         {
             // Skip the '//'
             position += 2;
-            index = url.find_first_of("/?#", position);
-            host_.assign(url, position, index - position);
-            position = index;
+            while (index < position)
+            {
+                index = static_cast<uint32_t>(delimiters.next());
+            }
+
+            // The netloc ends at the first of "/?#". Userinfo ends at its first '@',
+            // and the port starts at the first ':' of what follows.
+            uint32_t at = length;
+            uint32_t colon = length;
+            for (; index < length; index = static_cast<uint32_t>(delimiters.next()))
+            {
+                char c = data[index];
+                if (c == '/' || c == '?' || c == '#')
+                {
+                    break;
+                }
+                else if (c == '@' && at == length)
+                {
+                    at = index;
+                    colon = length;
+                }
+                else if (c == ':' && colon == length)
+                {
+                    colon = index;
+                }
+            }
+            uint32_t end = index;
+            has_path = end < length;
 
-            // Extract any userinfo if there is any
-            index = host_.find('@');
-            if (index != std::string::npos)
+            uint32_t host_start = position;
+            if (at != length)
             {
-                userinfo_.assign(host_, 0, index);
-                host_.assign(host_, index + 1, std::string::npos);
+                userinfo_ = Span{position, at - position};
+                host_start = at + 1;
             }
 
             // Lowercase the hostname
-            std::transform(host_.begin(), host_.end(), host_.begin(), ::tolower);
+            std::transform(
+                buffer_.begin() + host_start, buffer_.begin() + end,
+                buffer_.begin() + host_start, ::tolower);
 
             // Try to find a port
-            index = host_.find(':');
-            if (index != std::string::npos)
+            if (colon != length)
             {
-                std::string portText(host_, index + 1, std::string::npos);
-                host_.resize(index);
-
-                if (portText.empty())
-                {
-                    port_ = 0;
-                }
-                else
+                host_ = Span{host_start, colon - host_start};
+                std::string_view port_text(data + colon + 1, end - colon - 1);
+                if (!port_text.empty())
                 {
-                    try
-                    {
-                        port_ = std::stoi(portText, &index);
-
-                        if (index != portText.length())
-                        {
-                            // Malformed port
-                            throw UrlParseException("Port not a number: " + portText);
-                        }
-
-                        if (port_ > 65535)
-                        {
-                            throw UrlParseException("Port too high: " + portText);
-                        }
-                        else if (port_ < 0)
-                        {
-                            throw UrlParseException("Port negative: " + portText);
-                        }
-                    }
-                    catch (const std::invalid_argument&)
-                    {
-                        // Malformed port
-                        throw UrlParseException("Port not a number: " + portText);
-                    }
-                    catch (const std::out_of_range&)
+                    ParseError error = parsePort(port_text, port_);
+                    if (error != ParseError::None)
                     {
-                        throw UrlParseException("Port out of integer range: " + portText);
+                        detail = port_text;
+                        return error;
                     }
                 }
             }
+            else
+            {
+                host_ = Span{host_start, end - host_start};
+            }
+            position = end;
         }
 
-        if (position != std::string::npos)
+        if (has_path)
         {
-            path_.assign(url, position, std::string::npos);
-
-            index = path_.find('#');
-            if (index != std::string::npos)
+            // The fragment starts at the first '#', the query at the first '?' before
+            // it and the params at the first ';' before that.
+            bool uses_params = Schemes::has(scheme_id_, Schemes::Params);
+            uint32_t semicolon = length;
+            uint32_t question = length;
+            uint32_t hash = length;
+            for (; index < length; index = static_cast<uint32_t>(delimiters.next()))
             {
-                fragment_.assign(path_, index + 1, std::string::npos);
-                path_.resize(index);
+                char c = data[index];
+                if (c == '#')
+                {
+                    hash = index;
+                    break;
+                }
+                else if (c == '?' && question == length)
+                {
+                    question = index;
+                }
+                else if (c == ';' && question == length && semicolon == length)
+                {
+                    semicolon = index;
+                }
             }
 
-            index = path_.find('?');
-            if (index != std::string::npos)
+            uint32_t end = hash;
+            if (hash != length)
+            {
+                fragment_ = Span{hash + 1, length - hash - 1};
+            }
+            if (question != length)
             {
-                query_.assign(path_, index + 1, std::string::npos);
+                query_ = Span{question + 1, end - question - 1};
                 has_query_ = true;
-                path_.resize(index);
+                end = question;
             }
+            if (uses_params && semicolon != length)
+            {
+                params_ = Span{semicolon + 1, end - semicolon - 1};
+                has_params_ = true;
+                end = semicolon;
+            }
+            path_ = Span{position, end - position};
+        }
+        return ParseError::None;
+    }
 
-            if (USES_PARAMS.find(scheme_) != USES_PARAMS.end())
+    void Url::replace(Span& span, std::string_view value)
+    {
+        changed();
+        if (value.size() <= span.length)
+        {
+            // Fits where the component was. `value` may overlap it.
+            std::char_traits<char>::move(&buffer_[span.offset], value.data(), value.size());
+            span.length = static_cast<uint32_t>(value.size());
+            return;
+        }
+
+        size_t used = scheme_.length + host_.length + path_.length + params_.length
+            + query_.length + fragment_.length + userinfo_.length
+            - span.length + value.size();
+        if (buffer_.size() + value.size() > std::numeric_limits<uint32_t>::max())
+        {
+            throw UrlParseException("URL too long.");
+        }
+
+        if (buffer_.size() + value.size() > 2 * used)
+        {
+            // Rebuild the buffer from the live components only
+            std::pmr::string compacted(buffer_.get_allocator());
+            compacted.reserve(used);
+            Span* spans[] = {
+                &scheme_, &userinfo_, &host_, &path_, &params_, &query_, &fragment_};
+            for (Span* other : spans)
             {
-                index = path_.find(';');
-                if (index != std::string::npos)
-                {
-                    params_.assign(path_, index + 1, std::string::npos);
-                    has_params_ = true;
-                    path_.resize(index);
-                }
+                std::string_view text = (other == &span) ? value : view(*other);
+                uint32_t offset = static_cast<uint32_t>(compacted.size());
+                compacted.append(text.data(), text.size());
+                other->offset = offset;
+                other->length = static_cast<uint32_t>(text.size());
             }
+            buffer_.swap(compacted);
+            return;
+        }
+
+        // `value` may point into the buffer, which appending can move
+        const char* begin = buffer_.data();
+        if (value.data() >= begin && value.data() < begin + buffer_.size())
+        {
+            size_t offset = value.data() - begin;
+            buffer_.reserve(buffer_.size() + value.size());
+            value = std::string_view(buffer_.data() + offset, value.size());
         }
+        span.offset = static_cast<uint32_t>(buffer_.size());
+        span.length = static_cast<uint32_t>(value.size());
+        buffer_.append(value.data(), value.size());
     }
 
     Url& Url::assign(const Url& other)
@@ -305,14 +356,15 @@ namespace Url
     bool Url::operator==(const Url& other) const
     {
         return (
-            (scheme_     == other.scheme_    ) &&
-            (userinfo_   == other.userinfo_  ) &&
-            (host_       == other.host_      ) &&
+            (scheme_id_  == other.scheme_id_ ) &&
+            (scheme_id_ != SchemeId::Other || scheme() == other.scheme()) &&
+            (userinfo()  == other.userinfo() ) &&
+            (host()      == other.host()     ) &&
             (port_       == other.port_      ) &&
-            (path_       == other.path_      ) &&
-            (params_     == other.params_    ) &&
-            (query_      == other.query_     ) &&
-            (fragment_   == other.fragment_  ) &&
+            (path()      == other.path()     ) &&
+            (params()    == other.params()   ) &&
+            (query()     == other.query()    ) &&
+            (fragment()  == other.fragment() ) &&
             (has_params_ == other.has_params_) &&
             (has_query_  == other.has_query_ )
         );
@@ -325,24 +377,7 @@ namespace Url
 
     bool Url::equiv(const Url& other)
     {
-        Url self_(*this);
-        Url other_(other);
-
-        self_.strip()
-             .sort_query()
-             .defrag()
-             .deuserinfo()
-             .abspath()
-             .escape()
-             .remove_default_port();
-        other_.strip()
-              .sort_query()
-              .defrag()
-              .deuserinfo()
-              .abspath()
-              .escape()
-              .remove_default_port();
-        return self_ == other_;
+        return canonicalize() == other.canonicalize();
     }
 
     std::string& Url::remove_repeats(std::string& str, const char chr)
@@ -366,539 +401,875 @@ namespace Url
 
     std::string Url::fullpath() const
     {
-        std::string result;
-        if (path_.empty() || path_[0] != '/')
-        {
-            result.append(1, '/');
-        }
-        result.append(path_);
-
-        if (has_params_)
+        const Serialized& serialized = serialized_.get(
+            [this](Serialized& out) { serialize(out); });
+        std::string_view tail = std::string_view(serialized.text).substr(serialized.path);
+        if (!tail.empty() && tail[0] == '/')
         {
-            result.append(";");
-            result.append(params_);
+            return std::string(tail);
         }
 
-        if (has_query_)
-        {
-            result.append("?");
-            result.append(query_);
-        }
-
-        if (!fragment_.empty())
-        {
-            result.append("#");
-            result.append(fragment_);
-        }
+        // An empty or relative path that str() leaves as it is
+        std::string result;
+        result.reserve(tail.size() + 1);
+        result.append(1, '/');
+        result.append(tail);
         return result;
     }
 
-    std::string Url::str() const
+    const std::string& Url::str() const
     {
-        std::string result;
+        return serialized_.get([this](Serialized& out) { serialize(out); }).text;
+    }
 
-        if (!scheme_.empty())
+    void Url::serialize(Serialized& out) const
+    {
+        std::string_view after_scheme;
+        if (scheme_.length != 0)
         {
-            result.append(scheme_);
-            if (USES_NETLOC.find(scheme_) == USES_NETLOC.end())
-            {
-                result.append(":");
-            }
-            else
-            {
-                result.append("://");
-            }
+            after_scheme = Schemes::has(scheme_id_, Schemes::Netloc) ? "://" : ":";
         }
-        else if (!host_.empty())
+        else if (host_.length != 0)
         {
-            result.append("//");
+            after_scheme = "//";
         }
 
-        if (!userinfo_.empty())
+        char port[16];
+        size_t port_length = 0;
+        if (port_)
         {
-            result.append(userinfo_);
-            result.append("@");
+            port_length = std::to_chars(port, port + sizeof(port), port_).ptr - port;
         }
 
-        if (!host_.empty())
+        size_t prefix = scheme_.length + after_scheme.size() + host_.length
+            + (userinfo_.length != 0 ? userinfo_.length + 1 : 0)
+            + (port_ ? port_length + 1 : 0);
+
+        std::string_view slash;
+        if (path_.length == 0)
         {
-            result.append(host_);
+            slash = prefix != 0 ? "/" : "";
         }
-
-        if (port_)
+        else if (host_.length != 0 && path()[0] != '/')
         {
-            result.append(":");
-            result.append(std::to_string(port_));
+            slash = "/";
         }
 
-        if (path_.empty())
+        std::string& text = out.text;
+        text.clear();
+        text.reserve(prefix + slash.size() + path_.length
+            + (has_params_ ? params_.length + 1 : 0)
+            + (has_query_ ? query_.length + 1 : 0)
+            + (fragment_.length != 0 ? fragment_.length + 1 : 0));
+
+        text.append(scheme());
+        text.append(after_scheme);
+        if (userinfo_.length != 0)
         {
-            if (!result.empty())
-            {
-                result.append("/");
-            }
+            text.append(userinfo());
+            text.append(1, '@');
         }
-        else
+        text.append(host());
+        if (port_)
         {
-            if (!host_.empty() && path_[0] != '/')
-            {
-                result.append(1, '/');
-            }
-            result.append(path_);
+            text.append(1, ':');
+            text.append(port, port_length);
         }
 
+        out.path = text.size();
+        text.append(slash);
+        text.append(path());
+
         if (has_params_)
         {
-            result.append(";");
-            result.append(params_);
+            text.append(1, ';');
+            text.append(params());
         }
 
         if (has_query_)
         {
-            result.append("?");
-            result.append(query_);
+            text.append(1, '?');
+            text.append(query());
         }
 
-        if (!fragment_.empty())
+        if (fragment_.length != 0)
         {
-            result.append("#");
-            result.append(fragment_);
+            text.append(1, '#');
+            text.append(fragment());
         }
-
-        return result;
     }
 
     Url& Url::strip()
     {
-        size_t start = query_.find_first_not_of('?');
+        std::string value;
+        size_t start = query().find_first_not_of('?');
         if (start != std::string::npos)
         {
-            query_.assign(query_, start, std::string::npos);
+            value.assign(query(), start, std::string::npos);
         }
-        else
-        {
-            query_.assign("");
-        }
-        setQuery(remove_repeats(query_, '&'));
-        setParams(remove_repeats(params_, ';'));
+        setQuery(remove_repeats(value, '&'));
+        value.assign(params());
+        setParams(remove_repeats(value, ';'));
         return *this;
     }
 
     Url& Url::abspath()
     {
-        std::string copy;
-        std::vector<size_t> segment_starts;
+        if (path_.length == 0)
+        {
+            setPath("/");
+            return *this;
+        }
 
-        if (path_.size() >= 1 && path_[0] == '/')
+        changed();
+        path_.length = static_cast<uint32_t>(
+            resolveDotSegments(path(), &buffer_[path_.offset]));
+        return *this;
+    }
+
+    size_t Url::resolveDotSegments(std::string_view path, char* out)
+    {
+        // Segments are moved forward as they are kept, and a ".." backs up over the
+        // last one kept, which is found again by looking for the '/' before it. Kept
+        // segments are never longer than what was read, so `out` never overtakes the
+        // segment being read.
+        size_t length = 0;
+        if (!path.empty() && path[0] == '/')
         {
-            copy.append(1, '/');
-            segment_starts.push_back(0);
+            out[length++] = '/';
         }
 
         bool directory = false;
         size_t previous = 0;
-        size_t index = 0;
-        for (index = path_.find('/')
-            ; index != std::string::npos
-            ; previous = index + 1, index = path_.find('/', index + 1))
+        for (;;)
         {
-            // Skip empty segments
-            if (index - previous == 0)
+            size_t index = std::min(path.find('/', previous), path.size());
+            bool last = index == path.size();
+            std::string_view segment = path.substr(previous, index - previous);
+            if (segment.empty())
             {
-                continue;
+                // An empty last segment means the path names a directory
+                directory = directory || last;
             }
-
-            if ((index - previous == 2)
-                && path_[previous] == '.'
-                && path_[previous + 1] == '.')
+            else if (segment == "..")
             {
-                if (!segment_starts.empty())
+                if (length != 0)
                 {
-                    copy.resize(segment_starts.back());
-                    segment_starts.pop_back();
+                    size_t start = length - 1;
+                    while (start > 0 && out[start - 1] != '/')
+                    {
+                        --start;
+                    }
+                    length = start;
                 }
                 directory = true;
             }
-            else if ((index - previous == 1) && path_[previous] == '.')
+            else if (segment == ".")
             {
                 directory = true;
             }
             else
             {
-                segment_starts.push_back(copy.length());
-                copy.append(path_, previous, index - previous);
-                copy.append(1, '/');
+                std::char_traits<char>::move(out + length, segment.data(), segment.size());
+                length += segment.size();
+                if (!last)
+                {
+                    out[length++] = '/';
+                }
                 directory = false;
             }
-        }
 
-        // Handle the last segment
-        index = path_.length();
-        if (previous == path_.length())
-        {
-            directory = true;
-        }
-        else if ((index - previous == 1) && path_[previous] == '.')
-        {
-            directory = true;
-        }
-        else if ((index - previous == 2)
-                && path_[previous] == '.'
-                && path_[previous + 1] == '.')
-        {
-            if (!segment_starts.empty())
+            if (last)
             {
-                copy.resize(segment_starts.back());
+                break;
             }
-            directory = true;
-        }
-        else
-        {
-            copy.append(path_, previous, index - previous);
-            copy.append(1, '/');
-            directory = false;
+            previous = index + 1;
         }
 
-        if (!directory && copy.size() >= 1)
-        {
-            copy.resize(copy.size() - 1);
-        }
-        else if (directory && copy.empty())
+        if (directory && length == 0)
         {
-            copy.append(1, '/');
+            out[length++] = '/';
         }
-        path_.assign(copy);
+        return length;
+    }
 
+    Url& Url::relative_to(const Url& other)
+    {
+        resolve_relative(other, other.path().rfind('/') + 1);
         return *this;
     }
 
-    Url& Url::relative_to(const Url& other)
+    void Url::resolve_relative(const Url& base, size_t directory)
     {
         // If this scheme does not use relative, return it unchanged
-        if (USES_RELATIVE.find(scheme_) == USES_RELATIVE.end())
+        if (!Schemes::has(scheme_id_, Schemes::Relative))
         {
-            return *this;
+            return;
         }
 
-        // Support scheme-relative URLs
-        if (scheme_.empty())
+        // If this is an absolute URL (or scheme-relative), only the scheme may be
+        // missing
+        if (host_.length != 0)
         {
-            scheme_ = other.scheme_;
-        }
-
-        // If this is an absolute URL (or scheme-relative), return early
-        if (!host_.empty()) {
-            return *this;
+            if (scheme_.length == 0)
+            {
+                setScheme(base.scheme());
+            }
+            return;
         }
 
-        // If it's not an absolute URL, we need to copy the other host and port
-        host_ = other.host_;
-        port_ = other.port_;
-        userinfo_ = other.userinfo_;
-
-        // If the path portion is absolute, then bail out early.
-        if (!path_.empty() && path_.front() == '/')
+        // Otherwise the authority is the base's, and the path is evaluated relative
+        // to the base's unless it is absolute. Every component is gathered as a view
+        // first, of this URL or of the base, and written once.
+        std::string_view scheme = this->scheme();
+        SchemeId scheme_id = scheme_id_;
+        if (scheme_.length == 0)
         {
-            return *this;
+            scheme = base.scheme();
+            scheme_id = base.scheme_id_;
         }
-
-        // Otherwise, this is a path that need to be evaluated relative to the other. If
-        // there is no '/', then we just keep our current path if it's not empty.
-        if (path_.empty())
+        std::string_view prefix;
+        std::string_view path = this->path();
+        std::string_view params = this->params();
+        std::string_view query = this->query();
+        std::string_view fragment = this->fragment();
+        bool has_params = has_params_;
+        bool has_query = has_query_;
+
+        if (path_.length == 0)
         {
-            if (params_.empty())
+            // If there is no '/', then we just keep our current path if it's not empty
+            if (params_.length == 0)
             {
-                path_ = other.path_;
-                params_ = other.params_;
-                has_params_ = other.has_params_;
-                if (query_.empty())
+                path = base.path();
+                params = base.params();
+                has_params = base.has_params_;
+                if (query_.length == 0)
                 {
-                    query_ = other.query_;
-                    has_query_ = other.has_query_;
+                    query = base.query();
+                    has_query = base.has_query_;
                 }
             }
             else
             {
-                path_.assign(other.path_, 0, other.path_.rfind('/') + 1);
+                path = base.path().substr(0, directory);
             }
 
-            if (fragment_.empty())
+            if (fragment_.length == 0)
             {
-                fragment_ = other.fragment_;
+                fragment = base.fragment();
             }
         }
-        else
+        else if (path.front() != '/')
         {
-            size_t index = other.path_.rfind('/');
-            if (index != std::string::npos)
+            if (directory != 0)
             {
-                path_ = other.path_.substr(0, index + 1) + path_;
+                prefix = base.path().substr(0, directory);
             }
-            else if (!host_.empty())
+            else if (base.host_.length != 0)
             {
-                path_ = "/" + path_;
+                prefix = "/";
             }
         }
 
-        return *this;
+        size_t size = scheme.size() + base.userinfo_.length + base.host_.length
+            + prefix.size() + path.size() + params.size() + query.size() + fragment.size();
+        if (size > std::numeric_limits<uint32_t>::max())
+        {
+            throw UrlParseException("URL too long.");
+        }
+        std::pmr::string buffer(size, '\0', buffer_.get_allocator());
+        char* const begin = &buffer[0];
+        char* out = begin;
+        auto write = [begin, &out](Span& span, std::string_view first, std::string_view second)
+        {
+            span.offset = static_cast<uint32_t>(out - begin);
+            out = std::copy(first.begin(), first.end(), out);
+            out = std::copy(second.begin(), second.end(), out);
+            span.length = static_cast<uint32_t>(out - begin) - span.offset;
+        };
+        write(scheme_, scheme, {});
+        write(userinfo_, base.userinfo(), {});
+        write(host_, base.host(), {});
+        write(path_, prefix, path);
+        write(params_, params, {});
+        write(query_, query, {});
+        write(fragment_, fragment, {});
+        buffer_.swap(buffer);
+
+        scheme_id_ = scheme_id;
+        port_ = base.port_;
+        has_params_ = has_params;
+        has_query_ = has_query;
+        changed();
     }
 
     Url& Url::escape(bool strict)
     {
-        escape(path_, PATH, strict);
-        escape(query_, QUERY, strict);
-        escape(params_, QUERY, strict);
-        escape(userinfo_, USERINFO, strict);
+        std::string value(path());
+        replace(path_, escape(value, PATH, strict));
+        value.assign(query());
+        replace(query_, escape(value, QUERY, strict));
+        value.assign(params());
+        replace(params_, escape(value, QUERY, strict));
+        value.assign(userinfo());
+        replace(userinfo_, escape(value, USERINFO, strict));
         return *this;
     }
 
-    std::string& Url::escape(std::string& str, const CharacterClass& safe, bool strict)
+    namespace
     {
-        std::string copy(str);
-        size_t dest = 0;
-        // Allocate space pessimistically -- if every entity is expanded, it will take 3x
-        // the space.
-        str.resize(str.length() * 3);
-        for (size_t src = 0; src < copy.length(); ++src)
+        // Where escapeRun() puts its output
+        struct CountingSink
+        {
+            size_t size;
+
+            void put(char) { ++size; }
+        };
+
+        struct WritingSink
+        {
+            char* out;
+
+            void put(char c) { *out++ = c; }
+        };
+
+        /**
+         * Escape str from `src` on into `sink`. Returns whether any byte was expanded
+         * into an escape, which is what makes the output longer than the input.
+         *
+         * Every step reads its input before it puts its output, so the sink may
+         * write into str behind `src` as long as nothing expands.
+         */
+        template <typename Sink>
+        bool escapeRun(std::string_view str, size_t src, const CharacterClass& safe,
+                       bool strict, Sink& sink)
         {
-            if (copy[src] == '%' && (copy.length() - src) >= 2)
+            bool expanded = false;
+            for (; src < str.length(); ++src)
             {
-                // Read ahead to see if there's a valid escape sequence. If not, treat
-                // this like a normal character.
-                if (HEX_TO_DEC[copy[src+1]] != -1 && HEX_TO_DEC[copy[src+2]] != -1)
+                char c = str[src];
+                int high = -1;
+                int low = -1;
+                if (c == '%' && src + 2 < str.length())
+                {
+                    // Read ahead to see if there's a valid escape sequence. If not,
+                    // treat this like a normal character.
+                    high = Characters::hexValue(str[src + 1]);
+                    low = Characters::hexValue(str[src + 2]);
+                }
+
+                if (high >= 0 && low >= 0)
                 {
-                    int value = (
-                        HEX_TO_DEC[copy[src+1]] * 16 + HEX_TO_DEC[copy[src+2]]);
+                    src += 2;
+                    c = static_cast<char>(high * 16 + low);
 
                     // In strict mode, we can only unescape parameters if they are both
                     // safe and not reserved
-                    if (!strict || (strict && safe(value) && !RESERVED(value)))
+                    if (strict && (!safe(c) || Url::RESERVED(c)))
                     {
-                        // Replace src + 2 with that byte, advance src to consume it and
-                        // continue.
-                        src += 2;
-                        copy[src] = value;
-                    }
-                    else
-                    {
-                        str[dest++] = copy[src++];
-                        str[dest++] = ::toupper(copy[src++]);
-                        str[dest++] = ::toupper(copy[src]);
+                        sink.put('%');
+                        sink.put(Characters::hex[high]);
+                        sink.put(Characters::hex[low]);
                         continue;
                     }
                 }
-            }
+                else if (!safe(c))
+                {
+                    expanded = true;
+                }
 
-            if (!safe(copy[src]))
-            {
-                // Not safe -- replace with %XX
-                str[dest++] = '%';
-                str[dest++] = HEX.chars()[(copy[src] >> 4) & 0xF];
-                str[dest++] = HEX.chars()[copy[src] & 0xF];
-            }
-            else
-            {
-                str[dest++] = copy[src];
+                if (!safe(c))
+                {
+                    // Not safe -- replace with %XX
+                    sink.put('%');
+                    sink.put(Characters::hex[(c >> 4) & 0xF]);
+                    sink.put(Characters::hex[c & 0xF]);
+                }
+                else
+                {
+                    sink.put(c);
+                }
             }
+            return expanded;
         }
-        str.resize(dest);
-        return str;
     }
 
-    Url& Url::unescape()
+    std::string& Url::escape(std::string& str, const CharacterClass& safe, bool strict)
     {
-        unescape(path_);
-        unescape(query_);
-        unescape(params_);
-        unescape(userinfo_);
-        return *this;
+        // Most strings need no change, so look for the first byte that may need one
+        // before copying anything
+        size_t first = Scan::firstOutside(str, safe);
+        if (safe('%'))
+        {
+            first = std::min(first, str.find('%'));
+        }
+        if (first >= str.length())
+        {
+            return str;
+        }
+
+        CountingSink counter{first};
+        if (!escapeRun(str, first, safe, strict, counter))
+        {
+            // The output never overtakes the input, so rewrite it in place
+            WritingSink writer{&str[first]};
+            escapeRun(str, first, safe, strict, writer);
+            str.resize(counter.size);
+        }
+        else
+        {
+            std::string escaped(counter.size, '\0');
+            std::copy(str.begin(), str.begin() + first, escaped.begin());
+            WritingSink writer{&escaped[first]};
+            escapeRun(str, first, safe, strict, writer);
+            str.swap(escaped);
+        }
+        return str;
     }
 
-    std::string& Url::unescape(std::string& str)
+    namespace
     {
-        std::string copy(str);
-        size_t dest = 0;
-        for (size_t src = 0; src < copy.length(); ++src, ++dest)
+        // Where canonicalize() puts its output
+        struct StringSink
         {
-            if (copy[src] == '%' && (copy.length() - src) >= 2)
+            std::string& out;
+
+            void put(char c) { out.push_back(c); }
+            void append(std::string_view text) { out.append(text.data(), text.size()); }
+        };
+
+        // How canonicalize() escapes a component; `safe` is null to leave it as is
+        struct Escaping
+        {
+            const CharacterClass* safe;
+            bool strict;
+        };
+
+        template <typename Sink>
+        void putEscaped(std::string_view text, const Escaping& escaping, Sink& sink)
+        {
+            if (escaping.safe == nullptr)
             {
-                // Read ahead to see if there's a valid escape sequence. If not, treat
-                // this like a normal character.
-                if (HEX_TO_DEC[copy[src+1]] != -1 && HEX_TO_DEC[copy[src+2]] != -1)
-                {
-                    int value = (
-                        HEX_TO_DEC[copy[src+1]] * 16 + HEX_TO_DEC[copy[src+2]]);
+                sink.append(text);
+                return;
+            }
 
-                    // Replace src + 2 with that byte, advance src to consume it and
-                    // continue.
-                    src += 2;
-                    str[dest] = value;
-                    continue;
-                }
+            const CharacterClass& safe = *escaping.safe;
+            size_t first = Scan::firstOutside(text, safe);
+            if (safe('%'))
+            {
+                first = std::min(first, text.find('%'));
+            }
+            sink.append(text.substr(0, first));
+            if (first < text.size())
+            {
+                escapeRun(text, first, safe, escaping.strict, sink);
+            }
+        }
+
+        /**
+         * The first byte escapeRun() would put for `text`, which must not be empty.
+         */
+        char firstEscaped(std::string_view text, const Escaping& escaping)
+        {
+            char c = text[0];
+            if (escaping.safe == nullptr)
+            {
+                return c;
             }
 
-            // Either not a % or an incomplete entity
-            str[dest] = copy[src];
+            const CharacterClass& safe = *escaping.safe;
+            if (c == '%' && text.size() > 2)
+            {
+                int high = Characters::hexValue(text[1]);
+                int low = Characters::hexValue(text[2]);
+                if (high >= 0 && low >= 0)
+                {
+                    c = static_cast<char>(high * 16 + low);
+                    if (escaping.strict && (!safe(c) || Url::RESERVED(c)))
+                    {
+                        return '%';
+                    }
+                }
+            }
+            return safe(c) ? c : '%';
         }
-        str.resize(dest);
-        return str;
-    }
 
-    Url& Url::deparam(const std::unordered_set<std::string>& blacklist)
-    {
-        // Predicate is if it's present in the blacklist.
-        auto predicate = [blacklist](std::string& name, const std::string& value)
+        /**
+         * Put the query or params `text`, split on `glue`, the way strip() and
+         * sort_query(order) would leave it.
+         */
+        template <typename Sink>
+        void putPieces(std::string_view text, char glue, bool strip, bool sort,
+                       unsigned order, const Escaping& escaping, Sink& sink)
         {
-            std::transform(name.begin(), name.end(), name.begin(), ::tolower);
-            return blacklist.find(name) != blacklist.end();
-        };
+            if (strip)
+            {
+                if (glue == '&')
+                {
+                    // Also drop the extra ?s of "??a=b"
+                    size_t start = text.find_first_not_of('?');
+                    text = text.substr(std::min(start, text.size()));
+                }
+            }
+            else if (!sort)
+            {
+                putEscaped(text, escaping, sink);
+                return;
+            }
 
-        setQuery(remove_params(query_, predicate, '&'));
-        setParams(remove_params(params_, predicate, ';'));
-        return *this;
-    }
+            Pieces pieces(text, glue, strip);
+            if (!strip && pieces.size() <= 1)
+            {
+                // sort_query() leaves a single piece as it was
+                putEscaped(text, escaping, sink);
+                return;
+            }
+
+            if (sort)
+            {
+                pieces.sort(order);
+            }
+            for (size_t index = 0; index < pieces.size(); ++index)
+            {
+                if (index != 0)
+                {
+                    sink.put(glue);
+                }
+                putEscaped(pieces[index], escaping, sink);
+            }
+        }
 
-    Url& Url::deparam(const deparam_predicate& predicate)
-    {
-        setQuery(remove_params(query_, predicate, '&'));
-        setParams(remove_params(params_, predicate, ';'));
-        return *this;
     }
 
-    std::string& Url::remove_params(std::string& str,
-                            const deparam_predicate& predicate,
-                            char sep)
+    template <typename Sink>
+    void Url::canonicalize(Sink& sink, unsigned options) const
     {
-        std::string copy;
-        std::string piece;
-        std::string name;
-        std::string value;
-        size_t previous = 0;
-        for (size_t index = str.find(sep)
-            ; index != std::string::npos
-            ; previous = index + 1, index = str.find(sep, previous))
+        const bool strict = (options & Canonical::StrictEscape) != 0;
+        const bool escape = strict || (options & Canonical::Escape) != 0;
+        const bool strip = (options & Canonical::Strip) != 0;
+        const unsigned order = ((options & Canonical::SortByName) ? unsigned(Pieces::ByName) : 0u)
+            | ((options & Canonical::UniqueNames) ? unsigned(Pieces::UniqueName) : 0u);
+        const bool sort = order != 0 || (options & Canonical::SortQuery) != 0;
+        const Escaping verbatim{nullptr, false};
+
+        std::string_view userinfo = (options & Canonical::Deuserinfo) ? "" : this->userinfo();
+        std::string_view fragment = (options & Canonical::Defrag) ? "" : this->fragment();
+        int port = port_;
+        if ((options & Canonical::RemoveDefaultPort)
+            && port == Schemes::info(scheme_id_).default_port)
+        {
+            port = 0;
+        }
+
+        std::string_view path = this->path();
+        char local[256];
+        std::string spill;
+        if (options & Canonical::Abspath)
         {
-            piece.assign(str, previous, index - previous);
-            size_t position = piece.find('=');
-            name.assign(piece, 0, position);
-            value.clear();
-            if (position != std::string::npos)
+            char* out = local;
+            if (path.size() > sizeof(local))
             {
-                value.assign(piece, position + 1, std::string::npos);
+                spill.resize(path.size());
+                out = &spill[0];
             }
+            path = std::string_view(out, resolveDotSegments(path, out));
+        }
+
+        const Escaping path_escaping = escape ? Escaping{&PATH, strict} : verbatim;
+        const Escaping query_escaping = escape ? Escaping{&QUERY, strict} : verbatim;
+        const Escaping userinfo_escaping = escape ? Escaping{&USERINFO, strict} : verbatim;
+
+        // As in serialize()
+        bool prefix = false;
+        if (scheme_.length != 0)
+        {
+            sink.append(scheme());
+            sink.append(Schemes::has(scheme_id_, Schemes::Netloc) ? "://" : ":");
+            prefix = true;
+        }
+        else if (host_.length != 0)
+        {
+            sink.append("//");
+            prefix = true;
+        }
+
+        if (!userinfo.empty())
+        {
+            putEscaped(userinfo, userinfo_escaping, sink);
+            sink.put('@');
+            prefix = true;
+        }
+        if (host_.length != 0)
+        {
+            sink.append(host());
+        }
+        if (port)
+        {
+            char digits[16];
+            size_t length = std::to_chars(digits, digits + sizeof(digits), port).ptr - digits;
+            sink.put(':');
+            sink.append(std::string_view(digits, length));
+            prefix = true;
+        }
 
-            if (!predicate(name, value))
+        if (path.empty())
+        {
+            if (prefix)
             {
-                copy.append(copy.empty() ? 0 : 1, sep);
-                copy.append(piece);
+                sink.put('/');
             }
         }
-
-        if (previous < str.length())
+        else
         {
-            piece.assign(str, previous, std::string::npos);
-            size_t position = piece.find('=');
-            name.assign(piece, 0, position);
-            value.clear();
-            if (position != std::string::npos)
+            if (host_.length != 0 && firstEscaped(path, path_escaping) != '/')
             {
-                value.assign(piece, position + 1, std::string::npos);
+                sink.put('/');
             }
+            putEscaped(path, path_escaping, sink);
+        }
+
+        // Stripping a query or params down to nothing drops its separator too
+        if (has_params_ && (!strip || params().find_first_not_of(';') != std::string::npos))
+        {
+            sink.put(';');
+            putPieces(params(), ';', strip, sort, order, query_escaping, sink);
+        }
 
-            if (!predicate(name, value))
+        if (has_query_)
+        {
+            std::string_view query = this->query();
+            size_t start = strip ? query.find_first_not_of('?') : 0;
+            if (!strip || query.find_first_not_of('&', std::min(start, query.size()))
+                != std::string::npos)
             {
-                copy.append(copy.empty() ? 0 : 1, sep);
-                copy.append(piece);
+                sink.put('?');
+                putPieces(query, '&', strip, sort, order, query_escaping, sink);
             }
         }
 
-        str.assign(copy);
-        return str;
+        if (!fragment.empty())
+        {
+            sink.put('#');
+            sink.append(fragment);
+        }
     }
 
-    Url& Url::sort_query()
+    std::string Url::canonicalize(unsigned options) const
     {
-        split_sort_join(query_, '&');
-        split_sort_join(params_, ';');
+        std::string result;
+        result.reserve(buffer_.size() + 8);
+        StringSink sink{result};
+        canonicalize(sink, options);
+        return result;
+    }
+
+    uint64_t Url::fingerprint(unsigned options, uint64_t seed) const
+    {
+        Hash64 hasher(seed);
+        canonicalize(hasher, options);
+        return hasher.digest();
+    }
+
+    Url& Url::unescape()
+    {
+        std::string value(path());
+        replace(path_, unescape(value));
+        value.assign(query());
+        replace(query_, unescape(value));
+        value.assign(params());
+        replace(params_, unescape(value));
+        value.assign(userinfo());
+        replace(userinfo_, unescape(value));
         return *this;
     }
 
-    std::string& Url::split_sort_join(std::string& str, const char glue)
+    std::string& Url::unescape(std::string& str)
     {
-        // Return early if empty
-        if (str.empty())
+        size_t src = str.find('%');
+        if (src == std::string::npos)
         {
             return str;
         }
 
-        // Split
-        std::vector<std::string> pieces;
-        std::stringstream stream(str);
-        std::string item;
-        while (getline(stream, item, glue))
+        // Unescaping only ever shrinks the string, so it happens in place
+        char* data = &str[0];
+        size_t length = str.length();
+        size_t dest = src;
+        while (src < length)
         {
-            pieces.push_back(item);
+            // At a %, which either starts a run of entities or is left as-is
+            size_t decoded = Scan::decodeEscapes(data + src, length - src, data + dest);
+            if (decoded > 0)
+            {
+                src += 3 * decoded;
+                dest += decoded;
+            }
+            else
+            {
+                data[dest++] = data[src++];
+            }
+
+            // Move everything up to the next % along in one go
+            size_t next = str.find('%', src);
+            if (next == std::string::npos)
+            {
+                next = length;
+            }
+            std::copy(data + src, data + next, data + dest);
+            dest += next - src;
+            src = next;
         }
+        str.resize(dest);
+        return str;
+    }
 
-        // Return early if it's just a single element
-        if (pieces.size() == 1)
+    Url& Url::deparam(const std::unordered_set<std::string>& blacklist)
+    {
+        // Present if its lowercased name is in the blacklist
+        std::string lowered;
+        auto remove = [&blacklist, &lowered](std::string_view name, std::string_view)
         {
-            return str;
+            lowered.assign(name.data(), name.size());
+            std::transform(lowered.begin(), lowered.end(), lowered.begin(), ::tolower);
+            return blacklist.find(lowered) != blacklist.end();
+        };
+
+        remove_pieces(query_, '&', has_query_, remove);
+        remove_pieces(params_, ';', has_params_, remove);
+        return *this;
+    }
+
+    Url& Url::deparam(const deparam_predicate& predicate)
+    {
+        // The predicate takes strings it may change
+        std::string name_copy;
+        std::string value_copy;
+        auto remove = [&](std::string_view name, std::string_view value)
+        {
+            name_copy.assign(name.data(), name.size());
+            value_copy.assign(value.data(), value.size());
+            return predicate(name_copy, value_copy);
+        };
+
+        remove_pieces(query_, '&', has_query_, remove);
+        remove_pieces(params_, ';', has_params_, remove);
+        return *this;
+    }
+
+    Url& Url::deparam(const ParamFilter& filter)
+    {
+        remove_pieces(query_, '&', has_query_, filter);
+        remove_pieces(params_, ';', has_params_, filter);
+        return *this;
+    }
+
+    template <typename Remove>
+    void Url::remove_pieces(Span& span, char sep, bool& present, const Remove& remove)
+    {
+        changed();
+        // The pieces that are kept move towards the front, and never past the piece
+        // being read
+        char* data = &buffer_[span.offset];
+        const std::string_view text(data, span.length);
+        size_t length = 0;
+        for (size_t start = 0; start < text.size();)
+        {
+            size_t end = std::min(text.find(sep, start), text.size());
+            std::string_view piece = text.substr(start, end - start);
+            size_t equals = piece.find('=');
+            std::string_view value = (equals == std::string_view::npos)
+                ? std::string_view() : piece.substr(equals + 1);
+            if (!remove(piece.substr(0, equals), value))
+            {
+                // A separator only goes between pieces that were kept, so kept
+                // empty pieces at the front vanish
+                if (length != 0)
+                {
+                    data[length++] = sep;
+                }
+                std::char_traits<char>::move(data + length, piece.data(), piece.size());
+                length += piece.size();
+            }
+            start = end + 1;
         }
+        span.length = static_cast<uint32_t>(length);
+        present = length != 0;
+    }
 
-        // Sort
-        std::sort(pieces.begin(), pieces.end());
+    Url& Url::sort_query(unsigned order)
+    {
+        sort_pieces(query_, '&', order);
+        sort_pieces(params_, ';', order);
+        return *this;
+    }
 
-        // Join (at this point we know that there's at least one element)
-        std::stringstream output;
-        for (auto it = pieces.begin(); it != (pieces.end() - 1); ++it)
+    void Url::sort_pieces(Span& span, char glue, unsigned order)
+    {
+        Pieces pieces(view(span), glue, false);
+        if (pieces.size() <= 1)
         {
-            output << *it << glue;
+            // Left as it was, even with a trailing glue
+            return;
         }
-        output << pieces.back();
-        str.assign(output.str());
-        return str;
+        pieces.sort(order);
+
+        // Joined apart from the buffer, which the pieces point into, then written
+        // back over the component, which is never shorter
+        char local[256];
+        std::string spill;
+        char* out = local;
+        size_t size = pieces.joinedSize();
+        if (size > sizeof(local))
+        {
+            spill.resize(size);
+            out = &spill[0];
+        }
+        pieces.join(out);
+        replace(span, std::string_view(out, size));
     }
 
     Url& Url::remove_default_port()
     {
-        if (port_ && !scheme_.empty())
+        if (port_ && port_ == Schemes::info(scheme_id_).default_port)
         {
-            auto it = PORTS.find(scheme_);
-            if (it != PORTS.end() && port_ == it->second)
-            {
-                port_ = 0;
-            }
+            port_ = 0;
+            changed();
         }
         return *this;
     }
 
     Url& Url::deuserinfo()
     {
-        userinfo_.clear();
+        userinfo_.length = 0;
+        changed();
         return *this;
     }
 
     Url& Url::defrag()
     {
-        fragment_.clear();
+        fragment_.length = 0;
+        changed();
         return *this;
     }
 
     Url& Url::host_reversed()
     {
-        std::reverse(host_.begin(), host_.end());
-        for (size_t index = 0, position = 0; index < host_.size(); index = position + 1)
+        changed();
+        auto host = buffer_.begin() + host_.offset;
+        std::reverse(host, host + host_.length);
+        for (size_t index = 0, position = 0; index < host_.length; index = position + 1)
         {
-            position = host_.find('.', index);
+            position = this->host().find('.', index);
             if (position == std::string::npos)
             {
-                std::reverse(host_.begin() + index, host_.end());
+                std::reverse(host + index, host + host_.length);
                 break;
             }
             else
             {
-                std::reverse(host_.begin() + index, host_.begin() + position);
+                std::reverse(host + index, host + position);
             }
         }
         return *this;
@@ -1,13 +1,21 @@
 #ifndef URL_CPP_H
 #define URL_CPP_H
 
+#include <cstdint>
 #include <stdexcept>
 #include <functional>
+#include <memory_resource>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <unordered_map>
 #include <unordered_set>
 
+#include "character_class.h"
+#include "lazy.h"
+#include "param_filter.h"
+#include "scheme.h"
+
 namespace Url
 {
 
@@ -16,74 +24,100 @@ namespace Url
         UrlParseException(const std::string& message) : std::logic_error(message) {}
     };
 
-    struct CharacterClass
+    /**
+     * Why a URL could not be parsed.
+     */
+    enum class ParseError : uint8_t
     {
-        CharacterClass(const std::string& chars) : chars_(chars), map_(256, false)
-        {
-            for (auto it = chars_.begin(); it != chars_.end(); ++it)
-            {
-                map_[static_cast<size_t>(*it)] = true;
-            }
-        }
-
-        bool operator()(char c) const
-        {
-            return map_[static_cast<unsigned char>(c)];
-        }
+        None,
+        TooLong,
+        PortNotANumber,
+        // Outside the range of an int
+        PortOutOfRange,
+        PortTooHigh,
+        PortNegative
+    };
 
-        const std::string& chars() const
+    /**
+     * The normalizations Url::canonicalize() applies, combined with |. Each has the
+     * effect of the chainable method of the same name.
+     */
+    namespace Canonical
+    {
+        enum Option : unsigned
         {
-            return chars_;
-        }
-
-    private:
-        // Private, unimplemented to prevent use
-        CharacterClass();
-        CharacterClass(const CharacterClass& other);
-
-        std::string chars_;
-        std::vector<bool> map_;
-    };
+            Strip             = 1 << 0,
+            SortQuery         = 1 << 1,
+            Defrag            = 1 << 2,
+            Deuserinfo        = 1 << 3,
+            Abspath           = 1 << 4,
+            Escape            = 1 << 5,
+            // Escape as escape(true) does; implies Escape
+            StrictEscape      = 1 << 6,
+            RemoveDefaultPort = 1 << 7,
+            // Sort as sort_query(Pieces::ByName) does; implies SortQuery
+            SortByName        = 1 << 8,
+            // Sort as sort_query(Pieces::UniqueName) does; implies SortQuery
+            UniqueNames       = 1 << 9,
+            // What equiv() compares
+            Equivalence = Strip | SortQuery | Defrag | Deuserinfo | Abspath | Escape
+                | RemoveDefaultPort
+        };
+    }
+
+    class BaseUrl;
 
     struct Url
     {
         /* Character classes */
-        const static CharacterClass GEN_DELIMS;
-        const static CharacterClass SUB_DELIMS;
-        const static CharacterClass ALPHA;
-        const static CharacterClass DIGIT;
-        const static CharacterClass UNRESERVED;
-        const static CharacterClass RESERVED;
-        const static CharacterClass PCHAR;
-        const static CharacterClass PATH;
-        const static CharacterClass QUERY;
-        const static CharacterClass FRAGMENT;
-        const static CharacterClass USERINFO;
-        const static CharacterClass HEX;
-        const static CharacterClass SCHEME;
-        const static std::vector<signed char> HEX_TO_DEC;
-        const static std::unordered_map<std::string, int> PORTS;
-        const static std::unordered_set<std::string> USES_RELATIVE;
-        const static std::unordered_set<std::string> USES_NETLOC;
-        const static std::unordered_set<std::string> USES_PARAMS;
-        const static std::unordered_set<std::string> KNOWN_PROTOCOLS;
+        static constexpr CharacterClass GEN_DELIMS{Characters::GenDelims};
+        static constexpr CharacterClass SUB_DELIMS{Characters::SubDelims};
+        static constexpr CharacterClass ALPHA{Characters::Alpha};
+        static constexpr CharacterClass DIGIT{Characters::Digit};
+        static constexpr CharacterClass UNRESERVED{Characters::Unreserved};
+        static constexpr CharacterClass RESERVED{Characters::Reserved};
+        static constexpr CharacterClass PCHAR{Characters::Pchar};
+        static constexpr CharacterClass PATH{Characters::Path};
+        static constexpr CharacterClass QUERY{Characters::Query};
+        static constexpr CharacterClass FRAGMENT{Characters::Fragment};
+        static constexpr CharacterClass USERINFO{Characters::Userinfo};
+        static constexpr CharacterClass HEX{Characters::Hex};
+        static constexpr CharacterClass SCHEME{Characters::Scheme};
 
         // The type of the predicate used for removing parameters
         typedef std::function<bool(std::string&, std::string&)> deparam_predicate;
 
-        explicit Url(const std::string& url);
+        /**
+         * Parse a URL in a single pass. The URL is copied once into a buffer that
+         * all of its components point into, allocated from `resource`.
+         */
+        explicit Url(std::string_view url,
+                     std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+        /**
+         * Parse a URL without throwing on malformed input. Whether it parsed is
+         * reported through `error`; if it did not, the components are unspecified.
+         */
+        Url(std::string_view url, ParseError& error,
+            std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+        explicit Url(const std::string& url): Url(std::string_view(url)) { }
 
-        Url(const Url& other)
-            : scheme_(other.scheme_)
-            , host_(other.host_)
-            , port_(other.port_)
-            , path_(other.path_)
-            , params_(other.params_)
-            , query_(other.query_)
-            , fragment_(other.fragment_)
-            , userinfo_(other.userinfo_)
-            , has_params_(other.has_params_)
-            , has_query_(other.has_query_) { }
+        explicit Url(const char* url): Url(std::string_view(url)) { }
+
+        // Copies allocate from the default resource
+        Url(const Url& other) = default;
+
+        // A copy that allocates from `resource`
+        Url(const Url& other, std::pmr::memory_resource* resource);
+
+        Url& operator=(const Url& other) = default;
+
+        // Moves take the buffer, with its resource. A moved-from URL may only be
+        // assigned to or destroyed.
+        Url(Url&& other) = default;
+
+        Url& operator=(Url&& other) = default;
 
         /**
          * Take on the value of the other URL.
@@ -101,20 +135,45 @@ namespace Url
          */
         bool equiv(const Url& other);
 
+        /**
+         * The string the URL would have after strip(), sort_query(), defrag(),
+         * deuserinfo(), abspath(), escape() and remove_default_port(), as far as
+         * they are selected in `options`, without changing the URL.
+         *
+         * Each component is written once into the result, as those steps apply to it.
+         */
+        std::string canonicalize(unsigned options = Canonical::Equivalence) const;
+
+        /**
+         * The XXH64 hash of canonicalize(options) under `seed`, computed while the
+         * canonical form is walked, without building the string.
+         */
+        uint64_t fingerprint(unsigned options = Canonical::Equivalence, uint64_t seed = 0) const;
+
         /**************************************
          * Component-wise access and setting. *
+         *                                    *
+         * Components are views into the URL, *
+         * valid until it is next modified.   *
          **************************************/
-        const std::string& scheme() const { return scheme_; }
-        Url& setScheme(const std::string& s)
+        std::string_view scheme() const { return view(scheme_); }
+        Url& setScheme(std::string_view s)
         {
-            scheme_ = s;
+            // Before `s`, which may view the buffer, is moved by the replacement
+            scheme_id_ = Schemes::lookup(s);
+            replace(scheme_, s);
             return *this;
         }
 
-        const std::string& host() const { return host_; }
-        Url& setHost(const std::string& s)
+        /**
+         * The scheme as one of the schemes known to the parser.
+         */
+        SchemeId schemeId() const { return scheme_id_; }
+
+        std::string_view host() const { return view(host_); }
+        Url& setHost(std::string_view s)
         {
-            host_ = s;
+            replace(host_, s);
             return *this;
         }
 
@@ -122,43 +181,44 @@ namespace Url
         Url& setPort(int i)
         {
             port_ = i;
+            changed();
             return *this;
         }
 
-        const std::string& path() const { return path_; }
-        Url& setPath(const std::string& s)
+        std::string_view path() const { return view(path_); }
+        Url& setPath(std::string_view s)
         {
-            path_ = s;
+            replace(path_, s);
             return *this;
         }
 
-        const std::string& params() const { return params_; }
-        Url& setParams(const std::string& s)
+        std::string_view params() const { return view(params_); }
+        Url& setParams(std::string_view s)
         {
-            params_ = s;
+            replace(params_, s);
             has_params_ = !s.empty();
             return *this;
         }
 
-        const std::string& query() const { return query_; }
-        Url& setQuery(const std::string& s)
+        std::string_view query() const { return view(query_); }
+        Url& setQuery(std::string_view s)
         {
-            query_ = s;
+            replace(query_, s);
             has_query_ = !s.empty();
             return *this;
         }
 
-        const std::string& fragment() const { return fragment_; }
-        Url& setFragment(const std::string& s)
+        std::string_view fragment() const { return view(fragment_); }
+        Url& setFragment(std::string_view s)
         {
-            fragment_ = s;
+            replace(fragment_, s);
             return *this;
         }
 
-        const std::string& userinfo() const { return userinfo_; }
-        Url& setUserinfo(const std::string& s)
+        std::string_view userinfo() const { return view(userinfo_); }
+        Url& setUserinfo(std::string_view s)
         {
-            userinfo_ = s;
+            replace(userinfo_, s);
             return *this;
         }
 
@@ -170,9 +230,20 @@ namespace Url
         std::string fullpath() const;
 
         /**
-         * Get a new string representation of the URL.
+         * Resolve the "." and ".." segments of `path` into `out`, and drop its empty
+         * segments, the way abspath() does. `out` needs room for as many bytes as
+         * the path has, and for one if it has none; it may be path.data(), to resolve
+         * the path in place. Returns the length of the result.
+         */
+        static size_t resolveDotSegments(std::string_view path, char* out);
+
+        /**
+         * Get the string representation of the URL.
+         *
+         * It is built once and kept until the URL is changed, which invalidates
+         * the reference.
          **/
-        std::string str() const;
+        const std::string& str() const;
 
         /*********************
          * Chainable methods *
@@ -193,6 +264,9 @@ namespace Url
 
         /**
          * Evaluate this URL relative fo `other`, placing the result in this object.
+         *
+         * This parses `other` on every call; to resolve many links against one base,
+         * use a BaseUrl.
          */
         Url& relative_to(const std::string& other)
         {
@@ -235,11 +309,17 @@ namespace Url
         Url& deparam(const deparam_predicate& predicate);
 
         /**
-         * Put queries and params in sorted order.
+         * Remove any params or queries that `filter` matches.
+         */
+        Url& deparam(const ParamFilter& filter);
+
+        /**
+         * Put queries and params in sorted order: bytewise, or as the Pieces::Order
+         * values in `order` say.
          *
          * To ensure consistent comparisons, escape should be called beforehand.
          */
-        Url& sort_query();
+        Url& sort_query(unsigned order = 0);
 
         /**
          * Remove the port if it's the default for the scheme.
@@ -265,6 +345,36 @@ namespace Url
         // Private, unimplemented to prevent use.
         Url();
 
+        /**
+         * Parse `url` into this newly constructed object. For malformed ports,
+         * `detail` is set to the text of the port.
+         */
+        ParseError parse(std::string_view url, std::string_view& detail);
+
+        /**
+         * The message of the UrlParseException thrown for `error`.
+         */
+        static std::string describe(ParseError error, std::string_view detail);
+
+        /**
+         * A component of the URL, as a range of `buffer_`.
+         */
+        struct Span
+        {
+            uint32_t offset;
+            uint32_t length;
+        };
+
+        std::string_view view(const Span& span) const
+        {
+            return std::string_view(buffer_.data() + span.offset, span.length);
+        }
+
+        /**
+         * Point `span` at a copy of `value`, which may itself be a view into this URL.
+         */
+        void replace(Span& span, std::string_view value);
+
         /**
          * Remove repeated, leading, and trailing instances of chr from the string.
          */
@@ -281,31 +391,75 @@ namespace Url
         std::string& unescape(std::string& str);
 
         /**
-         * Remove any params that match entries in the blacklist.
+         * Drop the pieces of a component, split on `sep`, for which `remove(name,
+         * value)` is true, in place. `present` is whether the component is there
+         * at all, as has_query_ is for the query.
          */
-        std::string& remove_params(
-            std::string& str, const deparam_predicate& pred, char sep);
+        template <typename Remove>
+        void remove_pieces(Span& span, char sep, bool& present, const Remove& remove);
 
         /**
-         * Split the provided string by char, sort, join by char.
+         * relative_to(base), where the directory of the base's path, up to and
+         * including its last '/', is its first `directory` bytes. The components
+         * that change are written into a new buffer at once.
          */
-        std::string& split_sort_join(std::string& str, const char glue);
+        void resolve_relative(const Url& base, size_t directory);
+
+        /**
+         * Split a component on `glue`, sort the pieces and join them again.
+         */
+        void sort_pieces(Span& span, char glue, unsigned order);
 
         /**
          * Check that the hostname is valid, removing an optional trailing '.'.
          */
         void check_hostname(std::string& host);
 
-        std::string scheme_;
-        std::string host_;
-        int port_;
-        std::string path_;
-        std::string params_;
-        std::string query_;
-        std::string fragment_;
-        std::string userinfo_;
-        bool has_params_;
-        bool has_query_;
+        /**
+         * Forget what was derived from the components, after changing them.
+         */
+        void changed() noexcept
+        {
+            serialized_.reset();
+        }
+
+        struct Serialized
+        {
+            std::string text;
+            // Where the path starts in the text
+            size_t path = 0;
+        };
+
+        /**
+         * Write the string representation into `out`, in one allocation.
+         */
+        void serialize(Serialized& out) const;
+
+        /**
+         * Put the canonical form into `sink`, which takes single bytes with put() and
+         * runs of them with append().
+         */
+        template <typename Sink>
+        void canonicalize(Sink& sink, unsigned options) const;
+
+        // The parsed URL, with the scheme and host lowercased in place. Components
+        // that were replaced are appended, and the buffer is compacted once more of it
+        // is unused than used.
+        std::pmr::string buffer_;
+        Span scheme_ = {0, 0};
+        SchemeId scheme_id_ = SchemeId::None;
+        Span host_ = {0, 0};
+        int port_ = 0;
+        Span path_ = {0, 0};
+        Span params_ = {0, 0};
+        Span query_ = {0, 0};
+        Span fragment_ = {0, 0};
+        Span userinfo_ = {0, 0};
+        bool has_params_ = false;
+        bool has_query_ = false;
+        Lazy<Serialized> serialized_;
+
+        friend class BaseUrl;
     };
 
 }
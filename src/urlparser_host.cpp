@@ -4,109 +4,298 @@
 #include "urlparser.h"
 
 #include <iostream>
+#include <memory_resource>
 
+#include "host_cache.h"
+#include "lazy.h"
 #include "psl.h"
 
 namespace URL = Url;
 
-class TLD::Host::Impl {
+namespace {
+/// Where the parts of a host start, as offsets into the host itself
+struct HostParts {
+    size_t suffix = std::string::npos;
+    size_t domain = 0;
+    size_t domain_length = 0;
+    size_t subdomain = 0;
+    size_t subdomain_length = 0;
+    size_t fulldomain = 0;
+};
+}  // namespace
+
+class TLD::Context::Impl {
+    friend class TLD::Context;
     friend class TLD::Host;
 
    public:
-    static void loadPslFromPath(const std::string& filepath);
-    static void loadPslFromString(const std::string& filestr);
-    static bool isPslLoaded() noexcept;
+    Impl(URL::PSL psl, const bool ignore_www)
+        : psl(std::move(psl)), ignore_www(ignore_www) {}
+
+   private:
+    URL::AtomicPSL psl;
+    const bool ignore_www;
+    URL::HostCache<HostParts> host_cache;
+};
+
+class TLD::Host::Impl {
+    friend class TLD::Host;
 
    public:
-    Impl(const std::string& host, const bool ignore_www);
+    Impl(std::string_view host,
+         const HostParts& parts,
+         std::pmr::memory_resource* resource);
     ~Impl() = default;
 
+    static TLD::ErrorCode decompose(std::string_view host,
+                                    const bool ignore_www,
+                                    const URL::PSL& psl,
+                                    HostParts& parts);
+
     const std::string& domain() const noexcept;
     std::string domainName() const noexcept;
     const std::string& subdomain() const noexcept;
     const std::string& suffix() const noexcept;
-    const std::string& fulldomain() const noexcept;
-    const std::string& str() const noexcept;
+    std::string_view fulldomain() const noexcept;
+    inline const std::string& fulldomainString() const;
 
    private:
-    std::string host_;
+    /// the whole host, allocated like the Impl; the parts below are short
+    /// enough to stay within the strings themselves
+    std::pmr::string host_;
     std::string domain_;
     std::string subdomain_;
     std::string suffix_;
-    std::string fulldomain_;
-    static URL::PSL psl;
+    size_t fulldomain_;
+    /// fulldomain() as a string, copied out of host_ the first time it is
+    /// asked for; copies of a Host share their Impl, so this may be built by
+    /// any of their threads
+    URL::Lazy<std::string> fulldomain_string_;
 };
 
 ////////////////////////////////////////////////////////////////////////////////////////
-#ifndef DONT_INIT_PSL
-URL::PSL initiate_static_psl() {
-    URL::PSL psl;
-    try {
-        psl = URL::PSL::fromPath(PUBLIC_SUFFIX_LIST_DAT);
-    } catch (const std::invalid_argument&) {
-        psl = URL::PSL::fromString("");
-    }
-    return psl;
-}
-URL::PSL TLD::Host::Impl::psl = initiate_static_psl();
-#else
-URL::PSL TLD::Host::Impl::psl = URL::PSL::fromString("");
+TLD::Context& TLD::Context::global() noexcept {
+    static TLD::Context context;
+#ifdef DONT_INIT_PSL
+    static const bool emptied = (context.impl->psl.store(URL::PSL()), true);
+    (void)emptied;
 #endif
+    return context;
+}
+
+TLD::Context::Context(const bool ignore_www)
+    : impl(std::make_unique<Impl>(URL::PSL::builtin(), ignore_www)) {}
+
+TLD::Context::~Context() = default;
+
+void TLD::Context::loadPslFromPath(const std::string& filepath) {
+    impl->psl.store(URL::PSL::fromPath(filepath));
+    impl->host_cache.clear();
+}
+
+void TLD::Context::loadPslFromString(const std::string& filestr) {
+    impl->psl.store(URL::PSL::fromString(filestr));
+    impl->host_cache.clear();
+}
+
+void TLD::Context::loadPslFromBinary(const std::string& filepath) {
+    impl->psl.store(URL::PSL::mapBinary(filepath));
+    impl->host_cache.clear();
+}
+
+void TLD::Context::setHostCacheCapacity(const size_t capacity) {
+    impl->host_cache.resize(capacity);
+}
+
+TLD::Context::CacheStats TLD::Context::hostCacheStats() const {
+    const auto& cache = impl->host_cache;
+    return CacheStats{cache.hits(), cache.misses(), cache.size(),
+                      cache.capacity()};
+}
+
+bool TLD::Context::isPslLoaded() const noexcept {
+    return impl->psl.read()->numLevels() > 0;
+}
+
+bool TLD::Context::ignoreWWW() const noexcept {
+    return impl->ignore_www;
+}
 
-inline void TLD::Host::Impl::loadPslFromPath(const std::string& filepath) {
-    psl = URL::PSL::fromPath(filepath);
+TLD::Url TLD::Context::makeUrl(const std::string& url) const {
+    return TLD::Url(url, *this);
 }
 
-inline void TLD::Host::Impl::loadPslFromString(const std::string& filestr) {
-    psl = URL::PSL::fromString(filestr);
+TLD::Host TLD::Context::makeHost(const std::string& host) const {
+    return TLD::Host(host, *this);
 }
 
 void TLD::Host::loadPslFromPath(const std::string& filepath) {
-    TLD::Host::Impl::loadPslFromPath(filepath);
+    TLD::Context::global().loadPslFromPath(filepath);
 }
 
 void TLD::Host::loadPslFromString(const std::string& filestr) {
-    TLD::Host::Impl::loadPslFromString(filestr);
+    TLD::Context::global().loadPslFromString(filestr);
 }
 
-inline bool TLD::Host::Impl::isPslLoaded() noexcept {
-    return psl.numLevels() > 0;
+void TLD::Host::loadPslFromBinary(const std::string& filepath) {
+    TLD::Context::global().loadPslFromBinary(filepath);
 }
 
 bool TLD::Host::isPslLoaded() noexcept {
-    return TLD::Host::Impl::isPslLoaded();
+    return TLD::Context::global().isPslLoaded();
+}
+
+const char* TLD::errorMessage(const TLD::ErrorCode code) noexcept {
+    switch (code) {
+        case TLD::ErrorCode::Ok:
+            return "No error";
+        case TLD::ErrorCode::UrlTooLong:
+            return "URL too long";
+        case TLD::ErrorCode::PortNotANumber:
+            return "Port not a number";
+        case TLD::ErrorCode::PortOutOfRange:
+            return "Port out of range";
+        case TLD::ErrorCode::EmptyLabel:
+            return "Empty label in hostname";
+    }
+    return "Unknown error";
 }
 ////////////////////////////////////////////////////////////////////
 
-TLD::Host::Impl::Impl(const std::string& host_, const bool ignore_www)
-    : host_(host_), fulldomain_(host_) {
-    this->suffix_ = TLD::Host::Impl::psl.getTLD(host_);
-    size_t suffix_pos = fulldomain_.rfind("." + suffix_);
+TLD::ErrorCode TLD::Host::Impl::decompose(const std::string_view host,
+                                          const bool ignore_www,
+                                          const URL::PSL& psl,
+                                          HostParts& parts) {
+    const size_t offset = psl.suffixOffset(host);
+    std::string suffix;
+    if (offset != URL::PSL::npos) {
+        /// a suffix starting with '.' means the hostname has an empty label there
+        if (offset < host.size() && host[offset] == '.')
+            return TLD::ErrorCode::EmptyLabel;
+        // the PSL reports suffixes lowercased
+        suffix.reserve(host.size() - offset);
+        for (size_t i = offset; i < host.size(); ++i) {
+            const char c = host[i];
+            suffix.push_back((c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c);
+        }
+    }
+    if (!suffix.empty())
+        parts.suffix = host.size() - suffix.size();
+    size_t suffix_pos = host.rfind("." + suffix);
     size_t subdomain_pos = 0;
     if (suffix_pos == std::string::npos || suffix_pos < 1)
-        return;
-    domain_ = host_.substr(0, suffix_pos);
-    size_t domain_pos = domain_.find_last_of('.');
+        return TLD::ErrorCode::Ok;
+    parts.domain_length = suffix_pos;
+    const std::string_view domain(host.data(), suffix_pos);
+    size_t domain_pos = domain.find_last_of('.');
     if (domain_pos != std::string::npos) {
         if (ignore_www) {
-            size_t www_pos = domain_.find("www.");
+            size_t www_pos = domain.find("www.");
             if (www_pos != 0) {
                 if (www_pos != std::string::npos)
-                    return;
+                    return TLD::ErrorCode::Ok;
             } else {
                 subdomain_pos = 4;  // length of "www."
-                fulldomain_ = fulldomain_.substr(4);
+                parts.fulldomain = 4;
             }
         }
-        if (subdomain_pos < domain_pos)
-            subdomain_ =
-                domain_.substr(subdomain_pos, domain_pos - subdomain_pos);
-        domain_ = domain_.substr(domain_pos + 1);
+        if (subdomain_pos < domain_pos) {
+            parts.subdomain = subdomain_pos;
+            parts.subdomain_length = domain_pos - subdomain_pos;
+        }
+        parts.domain = domain_pos + 1;
+        parts.domain_length = suffix_pos - domain_pos - 1;
+    }
+    return TLD::ErrorCode::Ok;
+}
+
+TLD::Host::Impl::Impl(const std::string_view host_,
+                      const HostParts& parts,
+                      std::pmr::memory_resource* resource)
+    : host_(host_, resource),
+      domain_(host_.substr(parts.domain, parts.domain_length)),
+      subdomain_(host_.substr(parts.subdomain, parts.subdomain_length)),
+      fulldomain_(parts.fulldomain) {
+    if (parts.suffix != std::string::npos) {
+        // the PSL reports suffixes lowercased
+        suffix_.reserve(host_.size() - parts.suffix);
+        for (size_t i = parts.suffix; i < host_.size(); ++i) {
+            const char c = host_[i];
+            suffix_.push_back((c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c);
+        }
     }
 }
 
 TLD::Host::Host(const std::string& host, const bool ignore_www)
-    : impl(std::make_shared<Impl>(host, ignore_www)) {}
+    : Host(host, ignore_www, TLD::Context::global(),
+           std::pmr::get_default_resource()) {}
+
+TLD::Host::Host(const std::string& host, const TLD::Context& context)
+    : Host(host, context.ignoreWWW(), context,
+           std::pmr::get_default_resource()) {}
+
+TLD::Host::Host(const std::string_view host,
+                std::pmr::memory_resource& arena,
+                const bool ignore_www)
+    : Host(host, ignore_www, TLD::Context::global(), &arena) {}
+
+TLD::Host::Host(const std::string_view host,
+                const TLD::Context& context,
+                std::pmr::memory_resource& arena)
+    : Host(host, context.ignoreWWW(), context, &arena) {}
+
+TLD::Host::Host(const std::string_view host,
+                const bool ignore_www,
+                const TLD::Context& context,
+                std::pmr::memory_resource* resource) {
+    const TLD::ErrorCode error = assign(host, ignore_www, context, resource);
+    if (error != TLD::ErrorCode::Ok)
+        throw std::invalid_argument(std::string(TLD::errorMessage(error)) +
+                                    ": " + std::string(host));
+}
+
+TLD::ErrorCode TLD::Host::assign(const std::string_view host,
+                                 const bool ignore_www,
+                                 const TLD::Context& context,
+                                 std::pmr::memory_resource* resource) {
+    auto& cache = context.impl->host_cache;
+    HostParts parts;
+    TLD::ErrorCode error = TLD::ErrorCode::Ok;
+    if (!cache.lookup(host, ignore_www, parts)) {
+        const uint64_t generation = cache.generation();
+        error = Impl::decompose(host, ignore_www, *context.impl->psl.read(), parts);
+        if (error == TLD::ErrorCode::Ok)
+            cache.insert(host, ignore_www, parts, generation);
+        else
+            parts = HostParts();
+    }
+    // one allocation from `resource` for both the Impl and its reference count
+    impl = std::allocate_shared<Impl>(
+        std::pmr::polymorphic_allocator<Impl>(resource), host, parts, resource);
+    return error;
+}
+
+TLD::Result<TLD::Host> TLD::Host::parse(const std::string_view host,
+                                        const bool ignore_www) {
+    TLD::Host result;
+    const TLD::ErrorCode error =
+        result.assign(host, ignore_www, TLD::Context::global(),
+                      std::pmr::get_default_resource());
+    if (error != TLD::ErrorCode::Ok)
+        return error;
+    return result;
+}
+
+TLD::Result<TLD::Host> TLD::Host::parse(const std::string_view host,
+                                        const TLD::Context& context) {
+    TLD::Host result;
+    const TLD::ErrorCode error =
+        result.assign(host, context.ignoreWWW(), context,
+                      std::pmr::get_default_resource());
+    if (error != TLD::ErrorCode::Ok)
+        return error;
+    return result;
+}
 
 /// suffix:
 inline const std::string& TLD::Host::Impl::suffix() const noexcept {
@@ -136,11 +325,20 @@ const std::string& TLD::Host::domain() const noexcept {
 }
 
 /// fulldomain
-const std::string& TLD::Host::Impl::fulldomain() const noexcept {
-    return fulldomain_;
+std::string_view TLD::Host::Impl::fulldomain() const noexcept {
+    return std::string_view(host_).substr(fulldomain_);
+}
+
+inline const std::string& TLD::Host::Impl::fulldomainString() const {
+    return fulldomain_string_.get(
+        [this](std::string& string) { string = fulldomain(); });
 }
 
 const std::string& TLD::Host::fulldomain() const noexcept {
+    return impl->fulldomainString();
+}
+
+std::string_view TLD::Host::fulldomainView() const noexcept {
     return impl->fulldomain();
 }
 
@@ -154,6 +352,10 @@ std::string TLD::Host::domainName() const noexcept {
 }
 
 const std::string& TLD::Host::str() const noexcept {
+    return impl->fulldomainString();
+}
+
+std::string_view TLD::Host::strView() const noexcept {
     return impl->fulldomain();
 }
 
@@ -3,7 +3,9 @@
 //
 #include "urlparser.h"
 
+#include <algorithm>
 #include <iostream>
+#include <optional>
 
 #include "url.h"
 
@@ -14,24 +16,55 @@ class TLD::Url::Impl : public URL::Url {
     friend class TLD::Url;
 
    public:
-    Impl(const std::string& url, const bool ignore_www);
-
-    const TLD::Host* getHost() noexcept;
-    inline const std::string& hostName();
+    Impl(std::string_view url,
+         const bool ignore_www,
+         const TLD::Context& context,
+         std::pmr::memory_resource* resource);
+
+    Impl(std::string_view url,
+         const bool ignore_www,
+         const TLD::Context& context,
+         std::pmr::memory_resource* resource,
+         URL::ParseError& error);
+
+    /// a copy whose buffer comes from the same resource, and whose host is made
+    /// again on first use
+    Impl(const Impl& other);
+
+    inline const TLD::Host* getHost() const noexcept;
+    inline std::string_view hostName() const noexcept;
+
+    /// the components the string accessors return
+    struct Strings {
+        std::string protocol;
+        std::string query;
+        std::string fragment;
+        std::string userinfo;
+        std::string fulldomain;
+    };
+    inline const Strings& strings() const;
 
    private:
-    std::unique_ptr<TLD::Host> host_obj = nullptr;
+    /// Copies of a Url share this Impl, and so may call getHost() from several
+    /// threads at once
+    URL::Lazy<std::optional<TLD::Host>> host_obj;
+    /// copied out of the buffer, together, the first time one is asked for
+    URL::Lazy<Strings> strings_;
     const bool ignore_www = DEFAULT_IGNORE_WWW;
+    const TLD::Context& context;
+    /// where the buffer, and the host once it is made, are allocated
+    std::pmr::memory_resource* const resource;
 };
 
-inline std::vector<std::string> split(const std::string& str,
+
+inline std::vector<std::string> split(const std::string_view str,
                                       const char delim) noexcept {
     std::vector<std::string> strings;
     size_t start;
     size_t end = 0;
     while ((start = str.find_first_not_of(delim, end)) != std::string::npos) {
         end = str.find(delim, start);
-        strings.push_back(str.substr(start, end - start));
+        strings.emplace_back(str.substr(start, end - start));
     }
     return strings;
 }
@@ -41,23 +74,129 @@ bool TLD::Url::isPslLoaded() noexcept {
     return TLD::Host::isPslLoaded();
 }
 
-TLD::Url::Impl::Impl(const std::string& url, const bool ignore_www)
-    : URL::Url(url) , ignore_www(ignore_www) {}
+TLD::Url::Impl::Impl(std::string_view url,
+                     const bool ignore_www,
+                     const TLD::Context& context,
+                     std::pmr::memory_resource* resource)
+    : URL::Url(url, resource),
+      ignore_www(ignore_www),
+      context(context),
+      resource(resource) {}
+
+TLD::Url::Impl::Impl(std::string_view url,
+                     const bool ignore_www,
+                     const TLD::Context& context,
+                     std::pmr::memory_resource* resource,
+                     URL::ParseError& error)
+    : URL::Url(url, error, resource),
+      ignore_www(ignore_www),
+      context(context),
+      resource(resource) {}
+
+TLD::Url::Impl::Impl(const Impl& other)
+    : URL::Url(other, other.resource),
+      ignore_www(other.ignore_www),
+      context(other.context),
+      resource(other.resource) {}
+
+namespace {
+TLD::ErrorCode toErrorCode(const URL::ParseError error) noexcept {
+    switch (error) {
+        case URL::ParseError::None:
+            return TLD::ErrorCode::Ok;
+        case URL::ParseError::TooLong:
+            return TLD::ErrorCode::UrlTooLong;
+        case URL::ParseError::PortNotANumber:
+            return TLD::ErrorCode::PortNotANumber;
+        case URL::ParseError::PortOutOfRange:
+        case URL::ParseError::PortTooHigh:
+        case URL::ParseError::PortNegative:
+            return TLD::ErrorCode::PortOutOfRange;
+    }
+    return TLD::ErrorCode::PortNotANumber;
+}
+}  // namespace
+
+TLD::Result<TLD::Url> TLD::Url::parse(const std::string_view url,
+                                      const bool ignore_www,
+                                      const TLD::Context& context,
+                                      std::pmr::memory_resource* resource) {
+    URL::ParseError error;
+    // one allocation from `resource` for both the Impl and its reference count
+    auto impl = std::allocate_shared<TLD::Url::Impl>(
+        std::pmr::polymorphic_allocator<TLD::Url::Impl>(resource), url,
+        ignore_www, context, resource, error);
+    if (error != URL::ParseError::None)
+        return toErrorCode(error);
+    TLD::Url result;
+    result.impl = std::move(impl);
+    return result;
+}
 
-TLD::Url::Url(const std::string& url, const bool ignore_www)
-    : impl(std::make_unique<TLD::Url::Impl>(url, ignore_www)) {}
+TLD::Result<TLD::Url> TLD::Url::parse(const std::string_view url,
+                                      const bool ignore_www) {
+    return parse(url, ignore_www, TLD::Context::global(),
+                 std::pmr::get_default_resource());
+}
 
-const TLD::Host* TLD::Url::Impl::getHost() noexcept {
-    if (!host_obj)
-        host_obj = std::make_unique<TLD::Host>(hostName(), false);
-    /// we set ignore_www to false because we remove www in hostName function
-    return host_obj.get();
+TLD::Result<TLD::Url> TLD::Url::parse(const std::string_view url,
+                                      const TLD::Context& context) {
+    return parse(url, context.ignoreWWW(), context,
+                 std::pmr::get_default_resource());
 }
-const std::string& TLD::Url::Impl::hostName() {
-    if (ignore_www){
-        host_ = TLD::Host::removeWWW(host_);
-    }
-    return host_;
+
+TLD::Result<TLD::Url> TLD::Url::parse(const std::string_view url,
+                                      const TLD::Context& context,
+                                      std::pmr::memory_resource& arena) {
+    return parse(url, context.ignoreWWW(), context, &arena);
+}
+
+TLD::Url::Url(const std::string& url, const bool ignore_www)
+    : Url(url, ignore_www, TLD::Context::global(),
+          std::pmr::get_default_resource()) {}
+
+TLD::Url::Url(const std::string& url, const TLD::Context& context)
+    : Url(url, context.ignoreWWW(), context, std::pmr::get_default_resource()) {}
+
+TLD::Url::Url(const std::string_view url,
+              std::pmr::memory_resource& arena,
+              const bool ignore_www)
+    : Url(url, ignore_www, TLD::Context::global(), &arena) {}
+
+TLD::Url::Url(const std::string_view url,
+              const TLD::Context& context,
+              std::pmr::memory_resource& arena)
+    : Url(url, context.ignoreWWW(), context, &arena) {}
+
+TLD::Url::Url(const std::string_view url,
+              const bool ignore_www,
+              const TLD::Context& context,
+              std::pmr::memory_resource* resource)
+    : impl(std::allocate_shared<TLD::Url::Impl>(
+          std::pmr::polymorphic_allocator<TLD::Url::Impl>(resource), url,
+          ignore_www, context, resource)) {}
+
+inline const TLD::Host* TLD::Url::Impl::getHost() const noexcept {
+    return &*host_obj.get([this](std::optional<TLD::Host>& host) {
+        /// we set ignore_www to false because we remove www in hostName function.
+        /// A host that does not decompose is kept whole rather than thrown about.
+        host.emplace();
+        host->assign(hostName(), false, context, resource);
+    });
+}
+/// the host the breakdown is made from; the URL itself keeps its "www."
+std::string_view TLD::Url::Impl::hostName() const noexcept {
+    return ignore_www ? TLD::Host::removeWWW(host()) : host();
+}
+
+inline const TLD::Url::Impl::Strings& TLD::Url::Impl::strings() const {
+    return strings_.get([this](Strings& strings) {
+        strings.protocol = scheme();
+        strings.query = query();
+        strings.fragment = fragment();
+        strings.userinfo = userinfo();
+        strings.fulldomain = hostName();
+    });
 }
 
 const TLD::Host& TLD::Url::host() const {
@@ -81,6 +220,10 @@ const std::string& TLD::Url::domain() const noexcept {
 
 /// fulldomain
 const std::string& TLD::Url::fulldomain() const noexcept {
+    return impl->strings().fulldomain;
+}
+
+std::string_view TLD::Url::fulldomainView() const noexcept {
     return impl->hostName();
 }
 
@@ -94,7 +237,15 @@ std::string TLD::Url::str() const noexcept {
     return impl->str();
 }
 
+std::string_view TLD::Url::strView() const noexcept {
+    return impl->str();
+}
+
 const std::string& TLD::Url::protocol() const noexcept {
+    return impl->strings().protocol;
+}
+
+std::string_view TLD::Url::protocolView() const noexcept {
     return impl->scheme();
 }
 
@@ -103,23 +254,116 @@ const int TLD::Url::port() const noexcept {
 }
 
 const std::string& TLD::Url::query() const noexcept {
+    return impl->strings().query;
+}
+
+std::string_view TLD::Url::queryView() const noexcept {
     return impl->query();
 }
 
 const std::string& TLD::Url::fragment() const noexcept {
+    return impl->strings().fragment;
+}
+
+std::string_view TLD::Url::fragmentView() const noexcept {
     return impl->fragment();
 }
 
 const std::string& TLD::Url::userinfo() const noexcept {
+    return impl->strings().userinfo;
+}
+
+std::string_view TLD::Url::userinfoView() const noexcept {
     return impl->userinfo();
 }
 
 std::string TLD::Url::abspath() const noexcept {
-    return impl->abspath().str();
+    return impl->canonicalize(URL::Canonical::Abspath);
+}
+
+std::string TLD::Url::normalizedPath() const noexcept {
+    const std::string_view path = impl->path();
+    std::string result(std::max<size_t>(path.size(), 1), '\0');
+    result.resize(URL::Url::resolveDotSegments(path, &result[0]));
+    return result;
+}
+
+/// the two enums differ in type only
+static constexpr bool same(const unsigned a, const unsigned b) {
+    return a == b;
+}
+
+static_assert(same(TLD::Canonical::Strip, URL::Canonical::Strip) &&
+                  same(TLD::Canonical::SortQuery, URL::Canonical::SortQuery) &&
+                  same(TLD::Canonical::Defrag, URL::Canonical::Defrag) &&
+                  same(TLD::Canonical::Deuserinfo, URL::Canonical::Deuserinfo) &&
+                  same(TLD::Canonical::Abspath, URL::Canonical::Abspath) &&
+                  same(TLD::Canonical::Escape, URL::Canonical::Escape) &&
+                  same(TLD::Canonical::StrictEscape, URL::Canonical::StrictEscape) &&
+                  same(TLD::Canonical::RemoveDefaultPort, URL::Canonical::RemoveDefaultPort) &&
+                  same(TLD::Canonical::SortByName, URL::Canonical::SortByName) &&
+                  same(TLD::Canonical::UniqueNames, URL::Canonical::UniqueNames) &&
+                  same(TLD::Canonical::Equivalence, URL::Canonical::Equivalence),
+              "TLD::Canonical mirrors Url::Canonical");
+
+class TLD::ParamFilter::Impl : public URL::ParamFilter {};
+
+TLD::ParamFilter::ParamFilter() : impl(std::make_unique<Impl>()) {}
+
+TLD::ParamFilter::ParamFilter(std::initializer_list<std::string_view> rules)
+    : ParamFilter() {
+    for (const std::string_view rule : rules)
+        impl->add(rule);
+}
+
+/// moves leave `impl` null, which stands for a filter that removes nothing, so
+/// that they need not allocate; add() and predicate() make a new one
+TLD::ParamFilter::~ParamFilter() = default;
+TLD::ParamFilter::ParamFilter(TLD::ParamFilter&& other) noexcept = default;
+TLD::ParamFilter& TLD::ParamFilter::operator=(
+    TLD::ParamFilter&& other) noexcept = default;
+
+TLD::ParamFilter& TLD::ParamFilter::add(const std::string_view rule) {
+    if (!impl)
+        impl = std::make_unique<Impl>();
+    impl->add(rule);
+    return *this;
+}
+
+TLD::ParamFilter& TLD::ParamFilter::predicate(Predicate predicate) {
+    if (!impl)
+        impl = std::make_unique<Impl>();
+    impl->predicate(std::move(predicate));
+    return *this;
+}
+
+bool TLD::ParamFilter::matches(const std::string_view name,
+                               const std::string_view value) const {
+    return impl && impl->matches(name, value);
+}
+
+TLD::Url TLD::Url::deparam(const TLD::ParamFilter& filter) const {
+    /// a copy of the Impl in the same arena
+    auto filtered = std::allocate_shared<TLD::Url::Impl>(
+        std::pmr::polymorphic_allocator<TLD::Url::Impl>(impl->resource), *impl);
+    static const TLD::ParamFilter::Impl nothing;
+    filtered->deparam(filter.impl ? *filter.impl : nothing);
+    TLD::Url result;
+    result.impl = std::move(filtered);
+    return result;
+}
+
+std::string TLD::Url::canonicalize(const unsigned options) const noexcept {
+    return impl->canonicalize(options);
+}
+
+uint64_t TLD::Url::fingerprint(const unsigned options,
+                               const uint64_t seed) const noexcept {
+    return impl->fingerprint(options, seed);
 }
 
 TLD::QueryParams TLD::Url::params() const noexcept {
-    return split(query(), '&');
+    return split(queryView(), '&');
 }
 
 std::string TLD::Url::extractHost(const std::string& url) noexcept {
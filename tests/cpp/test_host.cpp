@@ -66,8 +66,79 @@ TEST_P(CSVHostTest, HostDataInput) {
     const HostData& host_data = GetParam();
     TLD::Host host = TLD::Host::fromUrl(host_data.url, host_data.ignore_www);
     EXPECT_EQ(host.str(), host_data.host);
+    EXPECT_EQ(host.strView(), host_data.host);
+    EXPECT_EQ(host.fulldomainView(), host.fulldomain());
     EXPECT_EQ(host.domain(), host_data.domain);
     EXPECT_EQ(host.domainName(), host_data.domain_name);
     EXPECT_EQ(host.suffix(), host_data.suffix);
 }
 
+
+TEST(ContextTest, ContextsAreIndependent) {
+    TLD::Context icann;
+    TLD::Context internal(true);
+    internal.loadPslFromString("com\ncorp.example.com\n");
+    ASSERT_TRUE(icann.isPslLoaded());
+    ASSERT_TRUE(internal.isPslLoaded());
+
+    const TLD::Host host = icann.makeHost("wiki.corp.example.com");
+    EXPECT_EQ(host.suffix(), "com");
+    EXPECT_EQ(host.domain(), "example");
+
+    const TLD::Url url = internal.makeUrl("https://www.wiki.corp.example.com/");
+    EXPECT_EQ(url.fulldomain(), "wiki.corp.example.com");
+    EXPECT_EQ(url.suffix(), "corp.example.com");
+    EXPECT_EQ(url.domain(), "wiki");
+
+    // The global context is untouched
+    EXPECT_EQ(TLD::Host("wiki.corp.example.com").suffix(), "com");
+}
+
+TEST(ContextTest, HostCacheRemembersHosts) {
+    TLD::Context plain;
+    TLD::Context www(true);
+    EXPECT_EQ(plain.hostCacheStats().capacity, 0u);
+    plain.setHostCacheCapacity(64);
+    www.setHostCacheCapacity(64);
+    const std::vector<HostData> rows =
+        load_host_data(makeAbsolutePath("data/host_data.csv"));
+    for (int round = 0; round < 2; ++round) {
+        for (const HostData& row : rows) {
+            const TLD::Host host(TLD::Url::extractHost(row.url),
+                                 row.ignore_www ? www : plain);
+            EXPECT_EQ(host.str(), row.host) << row.toString();
+            EXPECT_EQ(host.domain(), row.domain) << row.toString();
+            EXPECT_EQ(host.domainName(), row.domain_name) << row.toString();
+            EXPECT_EQ(host.suffix(), row.suffix) << row.toString();
+        }
+    }
+    const TLD::Context::CacheStats stats = plain.hostCacheStats();
+    EXPECT_GT(stats.hits, 0u);
+    EXPECT_EQ(stats.hits + stats.misses + www.hostCacheStats().hits +
+                  www.hostCacheStats().misses,
+              2 * rows.size());
+    EXPECT_LE(stats.size, stats.capacity);
+
+    // A new list invalidates what was cached
+    plain.loadPslFromString("com\ncorp.example.com\n");
+    EXPECT_EQ(plain.hostCacheStats().size, 0u);
+    EXPECT_EQ(plain.makeHost("wiki.corp.example.com").suffix(),
+              "corp.example.com");
+}
+
+TEST(HostTest, ParseReportsErrorsWithoutThrowing) {
+    const auto host = TLD::Host::parse("www.example.co.uk", true);
+    ASSERT_TRUE(host);
+    EXPECT_EQ(host->domain(), "example");
+    EXPECT_EQ(host->suffix(), "co.uk");
+
+    // "*.ck" makes the empty label part of the suffix
+    const auto empty = TLD::Host::parse("a..ck");
+    EXPECT_EQ(empty.error(), TLD::ErrorCode::EmptyLabel);
+    EXPECT_THROW(TLD::Host("a..ck"), std::invalid_argument);
+
+    // A URL whose host does not decompose keeps it whole
+    const TLD::Url url("http://a..ck/");
+    EXPECT_EQ(url.suffix(), "");
+    EXPECT_EQ(url.host().str(), "a..ck");
+}
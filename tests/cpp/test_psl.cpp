@@ -0,0 +1,171 @@
+#include <gtest/gtest.h>
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "psl.h"
+#include "punycode.h"
+#include "common.h"
+
+
+std::vector<std::string> load_psl_hosts(const std::string& filename) {
+    // One host below every rule of the list
+    std::vector<std::string> hosts;
+    std::ifstream f(filename);
+    std::string line;
+    while (std::getline(f, line)) {
+        if (line.empty() || line.compare(0, 2, "//") == 0)
+            continue;
+        size_t trim = (line[0] == '*') ? 2 : (line[0] == '!') ? 1 : 0;
+        hosts.push_back("host." + line.substr(trim));
+    }
+    return hosts;
+}
+
+TEST(PSLTest, BuiltinMatchesParsedList) {
+    const Url::PSL parsed = Url::PSL::fromPath(PUBLIC_SUFFIX_LIST_DAT);
+    const Url::PSL builtin = Url::PSL::builtin();
+    ASSERT_GT(builtin.numLevels(), 0u);
+    EXPECT_EQ(builtin.numLevels(), parsed.numLevels());
+    for (const auto& host : load_psl_hosts(PUBLIC_SUFFIX_LIST_DAT)) {
+        EXPECT_EQ(builtin.getBoth(host), parsed.getBoth(host)) << host;
+    }
+}
+
+TEST(PSLTest, WildcardAndExceptionRules) {
+    const Url::PSL psl = Url::PSL::fromString("jp\n*.kawasaki.jp\n!city.kawasaki.jp\n");
+    EXPECT_EQ(psl.getTLD("a.b.kawasaki.jp"), "b.kawasaki.jp");
+    EXPECT_EQ(psl.getTLD("city.kawasaki.jp"), "kawasaki.jp");
+    EXPECT_EQ(psl.getTLD("Example.JP"), "jp");
+    EXPECT_EQ(psl.getTLD("example.unknown"), "unknown");
+    EXPECT_EQ(psl.getPLD("www.city.kawasaki.jp"), "city.kawasaki.jp");
+}
+
+TEST(PSLTest, BinarySnapshotRoundTrip) {
+    const std::string path =
+        (std::filesystem::temp_directory_path() / "liburlparser_psl.bin").string();
+    const Url::PSL builtin = Url::PSL::builtin();
+    builtin.saveBinary(path);
+    {
+        const Url::PSL mapped = Url::PSL::mapBinary(path);
+        EXPECT_EQ(mapped.numLevels(), builtin.numLevels());
+        for (const auto& host : load_psl_hosts(PUBLIC_SUFFIX_LIST_DAT)) {
+            EXPECT_EQ(mapped.getBoth(host), builtin.getBoth(host)) << host;
+        }
+    }
+    std::filesystem::remove(path);
+}
+
+TEST(PSLTest, MapBinaryRejectsOtherFiles) {
+    EXPECT_THROW(Url::PSL::mapBinary(PUBLIC_SUFFIX_LIST_DAT), std::invalid_argument);
+    EXPECT_THROW(Url::PSL::mapBinary("/nonexistent/psl.bin"), std::invalid_argument);
+}
+
+TEST(PSLTest, AtomicPSLSwapsWhileReading) {
+    Url::AtomicPSL shared(Url::PSL::fromString("uk\nco.uk\n"));
+    std::atomic<bool> done{false};
+    std::atomic<size_t> mismatches{0};
+    std::vector<std::thread> readers;
+    for (int i = 0; i < 4; ++i) {
+        readers.emplace_back([&] {
+            while (!done) {
+                std::string tld = shared.read()->getTLD("example.co.uk");
+                if (tld != "co.uk" && tld != "uk")
+                    mismatches += 1;
+            }
+        });
+    }
+    for (int i = 0; i < 20; ++i) {
+        shared.store(Url::PSL::fromString(i % 2 ? "uk\nco.uk\n" : "uk\n"));
+    }
+    done = true;
+    for (auto& reader : readers)
+        reader.join();
+    EXPECT_EQ(mismatches, 0u);
+    EXPECT_EQ(shared.read()->getTLD("example.co.uk"), "co.uk");
+}
+
+TEST(PSLTest, OffsetsPointIntoTheHostname) {
+    const Url::PSL psl = Url::PSL::fromString("uk\nco.uk\n*.kawasaki.jp\n");
+    const std::string_view host = "Mail.Example.CO.UK";
+    EXPECT_EQ(host.substr(psl.suffixOffset(host)), "CO.UK");
+    EXPECT_EQ(host.substr(psl.registrableOffset(host)), "Example.CO.UK");
+    EXPECT_EQ(psl.getBothOffsets(host), std::make_pair(size_t(13), size_t(5)));
+    EXPECT_EQ(psl.suffixOffset("co.uk"), 0u);
+    EXPECT_EQ(psl.registrableOffset("co.uk"), Url::PSL::npos);
+    EXPECT_EQ(psl.suffixOffset("kawasaki.jp"), Url::PSL::npos);
+    EXPECT_EQ(psl.getTLD("kawasaki.jp"), Url::PSL::not_found);
+}
+
+TEST(PSLTest, SectionsAnsweredFromOneLookup) {
+    const Url::PSL psl = Url::PSL::fromString(
+        "// ===BEGIN ICANN DOMAINS===\nuk\nco.uk\n// ===END ICANN DOMAINS===\n"
+        "// ===BEGIN PRIVATE DOMAINS===\nblogspot.co.uk\n// ===END PRIVATE DOMAINS===\n");
+    using Section = Url::PSL::Section;
+    const auto both = psl.getBoth("a.b.blogspot.co.uk", Section::Icann | Section::Private);
+    EXPECT_EQ(both.icann, std::make_pair(std::string("co.uk"), std::string("blogspot.co.uk")));
+    EXPECT_EQ(both.all, std::make_pair(std::string("blogspot.co.uk"), std::string("b.blogspot.co.uk")));
+    EXPECT_EQ(psl.getTLD("x.blogspot.co.uk"), "blogspot.co.uk");
+    EXPECT_EQ(psl.getTLD("x.blogspot.co.uk", Section::Icann), "co.uk");
+
+    const auto icann = psl.getBothOffsets("x.blogspot.co.uk", Section::Icann);
+    EXPECT_EQ(icann.icann, std::make_pair(size_t(11), size_t(2)));
+    EXPECT_EQ(icann.all, std::make_pair(Url::PSL::npos, Url::PSL::npos));
+}
+
+TEST(PSLTest, PunycodeEncodesLabels) {
+    const auto encode = [](std::string_view label, size_t capacity = 64) {
+        char buffer[64];
+        return std::string(buffer, Url::Punycode::encodeLabel(label, buffer, capacity));
+    };
+    EXPECT_EQ(encode("B\xc3\xbc" "cher"), "xn--bcher-kva");
+    // RFC 3492, section 7.1 (A)
+    EXPECT_EQ(encode("\xd9\x84\xd9\x8a\xd9\x87\xd9\x85\xd8\xa7\xd8\xa8\xd8\xaa\xd9\x83"
+                     "\xd9\x84\xd9\x85\xd9\x88\xd8\xb4\xd8\xb9\xd8\xb1\xd8\xa8\xd9\x8a"
+                     "\xd8\x9f"),
+              "xn--egbpdaj6bu4bxfgehfvwxn");
+    EXPECT_TRUE(Url::Punycode::isAscii("www.example.com"));
+    EXPECT_FALSE(Url::Punycode::isAscii("www.example.co\xc3\xbc"));
+    // Invalid UTF-8, and an ACE form too long for the buffer
+    EXPECT_EQ(encode("bad\xc3"), "");
+    EXPECT_EQ(encode("B\xc3\xbc" "cher", 8), "");
+}
+
+TEST(PSLTest, InternationalizedRulesMatchBothForms) {
+    // \xe5\x85\xac\xe5\x8f\xb8 is punycoded as xn--55qx5d
+    const Url::PSL psl = Url::PSL::fromString("cn\n\xe5\x85\xac\xe5\x8f\xb8.cn\n");
+    EXPECT_EQ(psl.getTLD("example.\xe5\x85\xac\xe5\x8f\xb8.cn"), "\xe5\x85\xac\xe5\x8f\xb8.cn");
+    EXPECT_EQ(psl.getTLD("example.xn--55qx5d.cn"), "xn--55qx5d.cn");
+    EXPECT_EQ(psl.getPLD("Example.XN--55QX5D.cn"), "example.xn--55qx5d.cn");
+    EXPECT_EQ(Url::PSL::builtin().getTLD("example.\xe5\x85\xac\xe5\x8f\xb8.cn"),
+              "\xe5\x85\xac\xe5\x8f\xb8.cn");
+    EXPECT_EQ(Url::PSL::builtin().getTLD("example.xn--55qx5d.cn"), "xn--55qx5d.cn");
+}
+
+TEST(PSLTest, BatchMatchesSingleLookups) {
+    std::vector<std::string> hosts = load_psl_hosts(PUBLIC_SUFFIX_LIST_DAT);
+    hosts.push_back("");
+    hosts.push_back("Mail.Example.CO.UK");
+    const std::vector<std::string_view> views(hosts.begin(), hosts.end());
+
+    // Large enough a list to take the interleaved path
+    std::string rules;
+    for (int tld = 0; tld < 100; ++tld)
+        for (int rule = 0; rule < 800; ++rule)
+            rules += "r" + std::to_string(rule) + ".t" + std::to_string(tld) + "\n";
+    const Url::PSL large = Url::PSL::fromString(rules + "uk\nco.uk\n");
+
+    for (const Url::PSL& psl : {Url::PSL::builtin(), large}) {
+        std::vector<std::pair<size_t, size_t>> out;
+        psl.getBothBatch(views, out);
+        ASSERT_EQ(out.size(), views.size());
+        for (size_t i = 0; i < views.size(); ++i)
+            EXPECT_EQ(out[i], psl.getBothOffsets(views[i])) << views[i];
+    }
+    std::pair<size_t, size_t> one;
+    const std::string_view host = "a.r7.t3";
+    large.getBothBatch(&host, 1, &one);
+    EXPECT_EQ(one, std::make_pair(size_t(2), size_t(0)));
+}
@@ -1,9 +1,18 @@
 #include <gtest/gtest.h>
+#include <atomic>
 #include <fstream>
+#include <iterator>
+#include <memory_resource>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <vector>
 
+#include "base_url.h"
+#include "hash64.h"
+#include "pieces.h"
+#include "scan.h"
+#include "url.h"
 #include "urlparser.h"
 #include "common.h"
 
@@ -89,3 +98,513 @@ TEST_P(CSVUrlTest, UrlDataInput) {
     EXPECT_EQ(url.fragment(), url_data.fragment);
 }
 
+
+TEST(UrlTest, ComponentsViewOneCopyOfTheUrl) {
+    const TLD::Url url("HTTPS://User:Pw@WWW.Example.CO.UK:8080/a/b;p?q=1&r=2#Frag", true);
+    EXPECT_EQ(url.protocol(), "https");
+    EXPECT_EQ(url.userinfo(), "User:Pw");
+    EXPECT_EQ(url.fulldomain(), "example.co.uk");
+    EXPECT_EQ(url.domain(), "example");
+    EXPECT_EQ(url.port(), 8080);
+    EXPECT_EQ(url.query(), "q=1&r=2");
+    EXPECT_EQ(url.fragment(), "Frag");
+    EXPECT_EQ(url.params(), TLD::QueryParams({"q=1", "r=2"}));
+    EXPECT_EQ(url.str(), "https://User:Pw@www.example.co.uk:8080/a/b;p?q=1&r=2#Frag");
+
+    // ignore_www is for the host breakdown; the URL keeps its "www."
+    const TLD::Url www("http://www.x.com/", true);
+    EXPECT_EQ(www.str(), "http://www.x.com/");
+    EXPECT_EQ(www.fulldomain(), "x.com");
+
+    EXPECT_EQ(url.protocolView(), url.protocol());
+    EXPECT_EQ(url.userinfoView(), url.userinfo());
+    EXPECT_EQ(url.fulldomainView(), url.fulldomain());
+    EXPECT_EQ(url.queryView(), url.query());
+    EXPECT_EQ(url.fragmentView(), url.fragment());
+    EXPECT_EQ(url.strView(), url.str());
+
+    // Views stay valid in copies of the Url
+    const TLD::Url copy = url;
+    EXPECT_EQ(copy.queryView().data(), url.queryView().data());
+}
+
+TEST(UrlTest, DelimiterKernelsAgree) {
+    const std::string text =
+        "https://user:pw@www.example.com:8080/a/b;c=d?e=f&g=h#i:/?#@;"
+        "no delimiters in this part of the string at all, then ;@#?/:";
+    const Url::Scan::Kernel best = Url::Scan::kernel();
+    std::vector<uint32_t> expected;
+    ASSERT_TRUE(Url::Scan::useKernel(Url::Scan::Kernel::Scalar));
+    for (size_t start = 0; start < text.size(); ++start)
+        expected.push_back(Url::Scan::delimiters(text.data() + start, text.size() - start));
+
+    for (auto kernel : {Url::Scan::Kernel::Sse42, Url::Scan::Kernel::Avx2}) {
+        if (!Url::Scan::useKernel(kernel))
+            continue;
+        for (size_t start = 0; start < text.size(); ++start)
+            EXPECT_EQ(Url::Scan::delimiters(text.data() + start, text.size() - start),
+                      expected[start]) << start;
+    }
+    Url::Scan::useKernel(best);
+
+    std::vector<size_t> positions;
+    Url::Scan::Delimiters delimiters(text, 0);
+    for (size_t position = delimiters.next(); position < text.size();
+         position = delimiters.next())
+        positions.push_back(position);
+    std::vector<size_t> scalar;
+    for (size_t i = 0; i < text.size(); ++i)
+        if (std::string_view(":/?#@;").find(text[i]) != std::string_view::npos)
+            scalar.push_back(i);
+    EXPECT_EQ(positions, scalar);
+}
+
+TEST(UrlTest, CharacterClassesMatchRfc3986) {
+    const std::string alpha = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz";
+    const std::string digit = "0123456789";
+    const std::string sub_delims = "!$&'()*+,;=";
+    const std::string unreserved = alpha + digit + "-._~";
+    const std::string pchar = unreserved + sub_delims + ":@";
+    const std::vector<std::pair<Url::CharacterClass, std::string>> classes = {
+        {Url::Url::GEN_DELIMS, ":/?#[]@"},
+        {Url::Url::SUB_DELIMS, sub_delims},
+        {Url::Url::ALPHA, alpha},
+        {Url::Url::DIGIT, digit},
+        {Url::Url::UNRESERVED, unreserved},
+        {Url::Url::RESERVED, ":/?#[]@" + sub_delims},
+        {Url::Url::PCHAR, pchar},
+        {Url::Url::PATH, pchar + "/"},
+        {Url::Url::QUERY, pchar + "/?"},
+        {Url::Url::FRAGMENT, pchar + "/?"},
+        {Url::Url::USERINFO, unreserved + sub_delims + ":"},
+        {Url::Url::HEX, "0123456789ABCDEF"},
+        {Url::Url::SCHEME, alpha + digit + "+-."},
+    };
+    for (const auto& [character_class, members] : classes) {
+        for (int value = 0; value < 256; ++value) {
+            const char c = static_cast<char>(value);
+            const bool expected = members.find(c) != std::string::npos;
+            EXPECT_EQ(character_class(c), expected) << members << " " << value;
+            const bool in_nibbles = value < 0x80 &&
+                ((character_class.nibbles()[value % 16] >> (value / 16)) & 1);
+            EXPECT_EQ(in_nibbles, expected) << members << " " << value;
+        }
+    }
+}
+
+TEST(UrlTest, EscapingAgreesAcrossKernels) {
+    std::string blob;
+    for (int i = 0; i < 40; ++i)
+        blob += (i == 33) ? "%zz" : "%7b%22";
+    const std::string url = "http://user%40:p w@example.com/a%2fb/c d/\xc3\xa9?q=" + blob + "#f";
+
+    const Url::Scan::Kernel best = Url::Scan::kernel();
+    ASSERT_TRUE(Url::Scan::useKernel(Url::Scan::Kernel::Scalar));
+    Url::Url expected_escaped(url);
+    expected_escaped.escape(true);
+    Url::Url expected_unescaped(url);
+    expected_unescaped.unescape();
+    EXPECT_EQ(expected_escaped.path(), "/a%2Fb/c%20d/%C3%A9");
+    EXPECT_EQ(expected_unescaped.path(), "/a/b/c d/\xc3\xa9");
+
+    for (auto kernel : {Url::Scan::Kernel::Sse42, Url::Scan::Kernel::Avx2}) {
+        if (!Url::Scan::useKernel(kernel))
+            continue;
+        Url::Url escaped(url);
+        escaped.escape(true);
+        EXPECT_EQ(escaped.str(), expected_escaped.str());
+        Url::Url unescaped(url);
+        unescaped.unescape();
+        EXPECT_EQ(unescaped.str(), expected_unescaped.str());
+    }
+    Url::Scan::useKernel(best);
+
+    // Already escaped components come back unchanged
+    Url::Url clean("http://example.com/a/b?c=d%20e");
+    clean.escape();
+    EXPECT_EQ(clean.str(), "http://example.com/a/b?c=d%20e");
+}
+
+TEST(UrlTest, SchemesResolveToIds) {
+    for (size_t id = 1; id < Url::Schemes::count - 1; ++id) {
+        const auto& info = Url::Schemes::infos[id];
+        EXPECT_EQ(Url::Schemes::lookup(info.name), static_cast<Url::SchemeId>(id)) << info.name;
+    }
+    EXPECT_EQ(Url::Schemes::lookup(""), Url::SchemeId::None);
+    EXPECT_EQ(Url::Schemes::lookup("mailto"), Url::SchemeId::Other);
+    EXPECT_EQ(Url::Schemes::lookup("httpx"), Url::SchemeId::Other);
+    EXPECT_EQ(Url::Schemes::lookup("svn+ssh+x"), Url::SchemeId::Other);
+
+    Url::Url url("HTTPS://example.com:443/a;b");
+    EXPECT_EQ(url.schemeId(), Url::SchemeId::Https);
+    EXPECT_EQ(url.params(), "b");
+    url.remove_default_port();
+    EXPECT_EQ(url.str(), "https://example.com/a;b");
+    url.setScheme("mailto");
+    EXPECT_EQ(url.schemeId(), Url::SchemeId::Other);
+    EXPECT_EQ(url.str(), "mailto:example.com/a;b");
+
+    // Digits after a known scheme are not taken for a port
+    EXPECT_EQ(Url::Url("Tel:5551234").schemeId(), Url::SchemeId::Tel);
+    EXPECT_EQ(Url::Url("localhost:8080").schemeId(), Url::SchemeId::None);
+}
+
+TEST(UrlTest, StrIsKeptUntilTheUrlChanges) {
+    Url::Url url("http://user@Example.com:8080/a/b;p?q=1#f");
+    const std::string& first = url.str();
+    EXPECT_EQ(first, "http://user@example.com:8080/a/b;p?q=1#f");
+    EXPECT_EQ(&url.str(), &first);
+    EXPECT_EQ(url.fullpath(), "/a/b;p?q=1#f");
+
+    url.setPort(81);
+    EXPECT_EQ(url.str(), "http://user@example.com:81/a/b;p?q=1#f");
+    url.deuserinfo().defrag();
+    EXPECT_EQ(url.str(), "http://example.com:81/a/b;p?q=1");
+    url.setPath("c");
+    EXPECT_EQ(url.str(), "http://example.com:81/c;p?q=1");
+    EXPECT_EQ(url.fullpath(), "/c;p?q=1");
+
+    // A copy makes its own string
+    const Url::Url copy(url);
+    EXPECT_EQ(copy.str(), url.str());
+    EXPECT_NE(&copy.str(), &url.str());
+
+    const Url::Url relative("mailto:someone");
+    EXPECT_EQ(relative.str(), "mailto:someone");
+    EXPECT_EQ(relative.fullpath(), "/someone");
+}
+
+TEST(UrlTest, CanonicalizeMatchesTheChainedMethods) {
+    const std::vector<std::string> inputs = {
+        "HTTP://user:pw@www.Example.COM:80/a/./b/../c/d%7e?utm=1&b=2&&a=3&c=%41#frag",
+        "https://example.com:443/../x//y/.?",
+        "http://example.com/a;b;;a?",
+        "http://example.com/%2Fa b?z&y&",
+        "mailto:someone@example.com",
+        "//example.com:8080",
+        "http://example.com/" + std::string(300, 'a') + "/../b",
+    };
+    using namespace Url::Canonical;
+    for (const std::string& input : inputs) {
+        const Url::Url url(input);
+        for (unsigned options :
+             {0u, unsigned(Equivalence), unsigned(Strip | SortQuery),
+              unsigned(Abspath | StrictEscape), unsigned(RemoveDefaultPort)}) {
+            Url::Url chained(url);
+            if (options & Strip) chained.strip();
+            if (options & SortQuery) chained.sort_query();
+            if (options & Defrag) chained.defrag();
+            if (options & Deuserinfo) chained.deuserinfo();
+            if (options & Abspath) chained.abspath();
+            if (options & (Escape | StrictEscape))
+                chained.escape((options & StrictEscape) != 0);
+            if (options & RemoveDefaultPort) chained.remove_default_port();
+            EXPECT_EQ(url.canonicalize(options), chained.str())
+                << input << " " << options;
+        }
+    }
+
+    EXPECT_EQ(Url::Url(inputs[0]).canonicalize(),
+              "http://www.example.com/a/c/d~?a=3&b=2&c=A&utm=1");
+    EXPECT_TRUE(Url::Url("http://example.com:80/a/../b?y&x")
+                    .equiv(Url::Url("http://example.com/b?x&y#f")));
+    EXPECT_EQ(TLD::Url("https://www.example.com/./a?b&a", true).canonicalize(),
+              "https://www.example.com/a?a&b");
+}
+
+TEST(UrlTest, FingerprintHashesTheCanonicalForm) {
+    EXPECT_EQ(Url::Hash64::hash(""), 0xEF46DB3751D8E999ULL);
+    EXPECT_EQ(Url::Hash64::hash("abc"), 0x44BC2CF5AD770999ULL);
+
+    // Any split of the input gives the same digest
+    const std::string text(100, 'x');
+    Url::Hash64 pieces(5);
+    pieces.append(text.substr(0, 3));
+    pieces.put('x');
+    pieces.append(text.substr(4, 60));
+    pieces.append(text.substr(64));
+    EXPECT_EQ(pieces.digest(), Url::Hash64::hash(text, 5));
+
+    const std::vector<std::string> inputs = {
+        "HTTP://user:pw@www.Example.COM:80/a/./b/../c/d%7e?utm=1&b=2&&a=3&c=%41#frag",
+        "https://example.com:443/../x//y/.?",
+        "mailto:someone@example.com",
+        "http://example.com/" + std::string(300, 'a') + "/../b?" +
+            std::string(100, 'q'),
+    };
+    using namespace Url::Canonical;
+    for (const std::string& input : inputs) {
+        const Url::Url url(input);
+        for (unsigned options : {0u, unsigned(Equivalence),
+                                 unsigned(Equivalence | SortByName | StrictEscape)}) {
+            for (uint64_t seed : {0ULL, 42ULL}) {
+                EXPECT_EQ(url.fingerprint(options, seed),
+                          Url::Hash64::hash(url.canonicalize(options), seed))
+                    << input << " " << options;
+            }
+        }
+    }
+
+    EXPECT_EQ(TLD::Url("http://example.com:80/a/../b?y&x#f").fingerprint(),
+              TLD::Url("HTTP://EXAMPLE.com/b?x&y").fingerprint());
+}
+
+TEST(UrlTest, NormalizesPathsInPlace) {
+    const std::vector<std::pair<std::string, std::string>> paths = {
+        {"", "/"},           {"/", "/"},         {".", "/"},
+        {"/a/b/../c", "/a/c"}, {"/a/./b/", "/a/b/"}, {"/a//b", "/a/b"},
+        {"/..", "/"},        {"/../a", "a"},     {"a/b/..", "a/"},
+        {"a", "a"},          {"/a/b/c/../../..", "/"},
+    };
+    for (const auto& [path, expected] : paths) {
+        std::string buffer(std::max<size_t>(path.size(), 1), '\0');
+        buffer.resize(Url::Url::resolveDotSegments(path, &buffer[0]));
+        EXPECT_EQ(buffer, expected) << path;
+
+        // In place
+        buffer = path;
+        buffer.resize(std::max<size_t>(path.size(), 1));
+        buffer.resize(Url::Url::resolveDotSegments(
+            std::string_view(buffer.data(), path.size()), &buffer[0]));
+        EXPECT_EQ(buffer, expected) << path;
+    }
+
+    Url::Url url("http://example.com/a/./b/../c?d#e");
+    EXPECT_EQ(url.abspath().str(), "http://example.com/a/c?d#e");
+
+    const TLD::Url shared("http://example.com/a/./b/../c?d#e");
+    const TLD::Url copy = shared;
+    EXPECT_EQ(shared.normalizedPath(), "/a/c");
+    EXPECT_EQ(shared.abspath(), "http://example.com/a/c?d#e");
+    // Neither changes the URL its copies share
+    EXPECT_EQ(copy.str(), "http://example.com/a/./b/../c?d#e");
+    EXPECT_EQ(TLD::Url("http://example.com").normalizedPath(), "/");
+}
+
+TEST(UrlTest, SortsQueriesByNameAndCollapsesNames) {
+    Url::Url url("http://example.com/p?b=2&a=9&b=1&a-x=0&a=1");
+    EXPECT_EQ(Url::Url(url).sort_query().query(), "a-x=0&a=1&a=9&b=1&b=2");
+    EXPECT_EQ(Url::Url(url).sort_query(Url::Pieces::ByName).query(),
+              "a=9&a=1&a-x=0&b=2&b=1");
+    EXPECT_EQ(Url::Url(url)
+                  .sort_query(Url::Pieces::ByName | Url::Pieces::UniqueName)
+                  .query(),
+              "a=9&a-x=0&b=2");
+    EXPECT_EQ(Url::Url(url).sort_query(Url::Pieces::UniqueName).query(),
+              "a=1&a-x=0&b=1");
+    EXPECT_EQ(url.canonicalize(Url::Canonical::UniqueNames),
+              "http://example.com/p?a=1&a-x=0&b=1");
+
+    // Split the way std::getline splits: only an empty last piece is dropped,
+    // and a single piece is left alone
+    EXPECT_EQ(Url::Url("http://e.com/?b&&a&").sort_query().query(), "&a&b");
+    EXPECT_EQ(Url::Url("http://e.com/?a&").sort_query().query(), "a&");
+
+    // More pieces than fit inline, and more bytes than the stack buffer
+    std::string query;
+    for (int i = 99; i >= 0; --i)
+        query += "key" + std::to_string(i) + "=" + (i % 2 ? "odd" : "even") +
+                 (i ? "&" : "");
+    const Url::Url many("http://e.com/?" + query);
+    Url::Url sorted(many);
+    sorted.sort_query();
+    EXPECT_EQ(sorted.query().size(), query.size());
+    EXPECT_EQ(sorted.query().substr(0, 22), "key0=even&key10=even&k");
+    EXPECT_EQ(many.canonicalize(Url::Canonical::SortQuery), sorted.str());
+}
+
+TEST(UrlTest, ParamFilterRemovesByNamePrefixAndPredicate) {
+    Url::ParamFilter filter{"fbclid", "UTM_*"};
+    filter.predicate([](std::string_view name, std::string_view value) {
+        return name == "debug" && value.empty();
+    });
+    EXPECT_TRUE(filter.matches("FbClid", "x"));
+    EXPECT_TRUE(filter.matches("utm_source", ""));
+    EXPECT_TRUE(filter.matches("debug", ""));
+    EXPECT_FALSE(filter.matches("debug", "1"));
+    EXPECT_FALSE(filter.matches("fbclid2", ""));
+    EXPECT_FALSE(filter.matches("utm", ""));
+
+    Url::Url url("http://example.com/p;utm_x=1;keep?Utm_Source=a&id=5&FBCLID=z&debug");
+    url.deparam(filter);
+    EXPECT_EQ(url.str(), "http://example.com/p;keep?id=5");
+
+    // Removing every piece drops the separator too, as the other overloads do
+    Url::Url bare("http://example.com/?fbclid=1&&utm_a");
+    EXPECT_EQ(bare.deparam(filter).str(), "http://example.com/");
+
+    // Many names still match through the table
+    Url::ParamFilter many;
+    for (int i = 0; i < 100; ++i)
+        many.add("name" + std::to_string(i));
+    EXPECT_TRUE(many.matches("NAME42", ""));
+    EXPECT_FALSE(many.matches("name100", ""));
+
+    const TLD::Url shared("https://www.example.com/?utm_medium=x&q=1", true);
+    const TLD::ParamFilter tracking{"utm_*"};
+    const TLD::Url clean = shared.deparam(tracking);
+    EXPECT_EQ(clean.str(), "https://www.example.com/?q=1");
+    EXPECT_EQ(clean.domain(), "example");
+    EXPECT_EQ(shared.query(), "utm_medium=x&q=1");
+
+    // A moved-from filter removes nothing until it is built up again
+    TLD::ParamFilter moved{"q"};
+    const TLD::ParamFilter taken = std::move(moved);
+    EXPECT_TRUE(taken.matches("q", "1"));
+    EXPECT_FALSE(moved.matches("q", "1"));
+    EXPECT_EQ(shared.deparam(moved).str(), "https://www.example.com/?utm_medium=x&q=1");
+    moved.add("utm_*");
+    EXPECT_EQ(shared.deparam(moved).str(), "https://www.example.com/?q=1");
+}
+
+TEST(UrlTest, BaseUrlResolvesLikeRelativeTo) {
+    const std::vector<std::string> bases = {
+        "https://user@www.example.com:8443/docs/guide/page.html;p?lang=en#top",
+        "http://example.com",
+        "http://example.com/a?b",
+        "ftp://example.com/dir/",
+    };
+    const std::vector<std::string> links = {
+        "",      "../img/logo.png", "chapter2.html", "/about",
+        "?q=1",  "#frag",           ";v=2",          ";v=2?q#f",
+        "?",     "//cdn.example.net/x.js", "https://other.org/a",
+        "mailto:someone@example.com",
+    };
+    for (const std::string& base : bases) {
+        const Url::BaseUrl resolver(base);
+        std::vector<Url::Url> resolved;
+        resolver.resolve(links.begin(), links.end(), std::back_inserter(resolved));
+        ASSERT_EQ(resolved.size(), links.size());
+        for (size_t index = 0; index < links.size(); ++index) {
+            Url::Url expected(links[index]);
+            expected.relative_to(base);
+            EXPECT_EQ(resolved[index], expected) << base << " " << links[index];
+            EXPECT_EQ(resolved[index].str(), expected.str())
+                << base << " " << links[index];
+        }
+    }
+
+    const Url::BaseUrl resolver("http://example.com/a/b/c");
+    EXPECT_EQ(resolver.resolve("d?e").str(), "http://example.com/a/b/d?e");
+    Url::Url self("http://example.com/a/b");
+    EXPECT_EQ(self.relative_to(self).str(), "http://example.com/a/b");
+}
+
+TEST(UrlTest, ParseReportsErrorsWithoutThrowing) {
+    const auto url = TLD::Url::parse("https://www.example.co.uk:8080/a?b#c", true);
+    ASSERT_TRUE(url);
+    EXPECT_EQ(url->port(), 8080);
+    EXPECT_EQ(url->fulldomain(), "example.co.uk");
+    EXPECT_EQ(*url, TLD::Url("https://www.example.co.uk:8080/a?b#c", true));
+
+    const std::vector<std::pair<std::string, TLD::ErrorCode>> malformed = {
+        {"http://example.com:80x/", TLD::ErrorCode::PortNotANumber},
+        {"http://example.com:x/", TLD::ErrorCode::PortNotANumber},
+        {"http://example.com:65536/", TLD::ErrorCode::PortOutOfRange},
+        {"http://example.com:-1/", TLD::ErrorCode::PortOutOfRange},
+        {"http://example.com:99999999999999999999/", TLD::ErrorCode::PortOutOfRange},
+    };
+    for (const auto& [input, code] : malformed) {
+        const auto result = TLD::Url::parse(input);
+        EXPECT_FALSE(result.ok()) << input;
+        EXPECT_EQ(result.error(), code) << input;
+        EXPECT_THROW(result.value(), std::invalid_argument) << input;
+        EXPECT_ANY_THROW(TLD::Url url(input)) << input;
+    }
+
+    // The ports std::stoi accepts still parse
+    EXPECT_EQ(TLD::Url::parse("http://example.com:+80/")->port(), 80);
+    EXPECT_EQ(TLD::Url::parse("http://example.com:/")->port(), 0);
+}
+
+namespace {
+// Counts what is allocated through it
+class CountingResource : public std::pmr::memory_resource {
+   public:
+    size_t allocations = 0;
+
+   private:
+    void* do_allocate(size_t bytes, size_t alignment) override {
+        ++allocations;
+        return std::pmr::new_delete_resource()->allocate(bytes, alignment);
+    }
+    void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+        std::pmr::new_delete_resource()->deallocate(p, bytes, alignment);
+    }
+    bool do_is_equal(const std::pmr::memory_resource& other) const
+        noexcept override {
+        return this == &other;
+    }
+};
+}  // namespace
+
+TEST(UrlTest, AllocatesFromAnArena) {
+    const std::string input = "https://user@www.shop.example.co.uk:8443/"
+                              "a/long/enough/path/to/leave/the/small/buffer?q=1#f";
+    CountingResource arena;
+    const TLD::Url expected(input, true);
+    {
+        TLD::Url url(input, arena, true);
+        const size_t parsed = arena.allocations;
+        EXPECT_GT(parsed, 0u);
+        EXPECT_EQ(url, expected);
+        EXPECT_EQ(url.host().domain(), "example");
+        EXPECT_EQ(url.host().suffix(), "co.uk");
+        EXPECT_EQ(url.host().fulldomain(), "shop.example.co.uk");
+        // The host is made on first use, from the same arena
+        EXPECT_GT(arena.allocations, parsed);
+
+        const auto result =
+            TLD::Url::parse(input, TLD::Context::global(), arena);
+        ASSERT_TRUE(result);
+        EXPECT_EQ(*result, TLD::Url(input));
+
+        // deparam copies the URL into the same arena, and none of it elsewhere
+        const TLD::ParamFilter filter{"q"};
+        CountingResource elsewhere;
+        std::pmr::memory_resource* const previous =
+            std::pmr::set_default_resource(&elsewhere);
+        const size_t before = arena.allocations;
+        const TLD::Url clean = url.deparam(filter);
+        std::pmr::set_default_resource(previous);
+        EXPECT_EQ(elsewhere.allocations, 0u);
+        EXPECT_GT(arena.allocations, before);
+        EXPECT_EQ(clean.str(),
+                  "https://user@www.shop.example.co.uk:8443/"
+                  "a/long/enough/path/to/leave/the/small/buffer#f");
+    }
+
+    // Everything comes out of a fixed buffer and nothing falls back to the heap
+    alignas(std::max_align_t) static char buffer[16 * 1024];
+    std::pmr::monotonic_buffer_resource bounded(
+        buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    const TLD::Host host("wiki.example.com", bounded);
+    EXPECT_EQ(host.str(), "wiki.example.com");
+    EXPECT_EQ(host.subdomain(), "wiki");
+    EXPECT_EQ(host, TLD::Host("wiki.example.com"));
+    EXPECT_NO_THROW(TLD::Url("http://example.com/path", bounded).host());
+}
+
+TEST(UrlTest, CopiesShareTheHostAcrossThreads) {
+    for (int round = 0; round < 50; ++round) {
+        const TLD::Url url("https://www.mail.example.co.uk/", true);
+        std::atomic<size_t> mismatches{0};
+        std::vector<const TLD::Host*> hosts(4);
+        std::vector<std::thread> readers;
+        for (size_t i = 0; i < hosts.size(); ++i) {
+            readers.emplace_back([&, i, copy = url] {
+                if (copy.domain() != "example" || copy.suffix() != "co.uk" ||
+                    copy.subdomain() != "mail" ||
+                    copy.str() != "https://www.mail.example.co.uk/")
+                    mismatches += 1;
+                hosts[i] = &copy.host();
+            });
+        }
+        for (auto& reader : readers)
+            reader.join();
+        EXPECT_EQ(mismatches, 0u);
+        // Every copy sees the one host made for them all
+        for (const TLD::Host* host : hosts)
+            EXPECT_EQ(host, &url.host());
+    }
+}